@@ -0,0 +1,68 @@
+#include "ActivityView.h"
+
+#include <cmath>
+
+namespace
+{
+// Gains between 0.01 and 12 are spread logarithmically over the palette
+int gainToPaletteIndex(float gain)
+{
+    if (gain <= 0.01f) { return 0; }
+
+    auto const position = std::log2(gain * 100.f) / std::log2(1200.f);
+    return juce::jlimit(0, 255, static_cast<int>(position * 255.f));
+}
+}  // namespace
+
+ActivityView::ActivityView(ActivityFrames& activityFrames)
+    : frames(activityFrames)
+    , raster(Image::RGB, historyLength, ActivityFrames::numBins, true)
+{
+    for (int i = 0; i < static_cast<int>(palette.size()); i++)
+    {
+        auto const level = static_cast<float>(i) / 255.f;
+        palette[i]       = Colour::fromHSV(0.12f - 0.12f * level, 1.f - 0.6f * level, level, 1.f);
+    }
+
+    setOpaque(true);
+    startTimerHz(framesPerSecond);
+}
+
+ActivityView::~ActivityView() { stopTimer(); }
+
+void ActivityView::timerCallback()
+{
+    if (!isShowing()) { return; }
+
+    auto const frame = frames.getLatestFrame();
+    if (frame == nullptr) { return; }
+
+    {
+        Image::BitmapData pixels(raster, Image::BitmapData::writeOnly);
+
+        // Neuron 0 at the bottom
+        for (int bin = 0; bin < ActivityFrames::numBins; bin++)
+        {
+            pixels.setPixelColour(nextColumn, ActivityFrames::numBins - 1 - bin,
+                                  palette[static_cast<size_t>(gainToPaletteIndex((*frame)[bin]))]);
+        }
+    }
+
+    nextColumn = (nextColumn + 1) % historyLength;
+    repaint();
+}
+
+void ActivityView::paint(Graphics& g)
+{
+    // The oldest column is the one about to be overwritten
+    auto const width     = getWidth();
+    auto const height    = getHeight();
+    auto const olderPart = historyLength - nextColumn;
+    auto const split     = width * olderPart / historyLength;
+
+    g.setImageResamplingQuality(Graphics::lowResamplingQuality);
+    g.drawImage(raster, 0, 0, split, height, nextColumn, 0, olderPart, ActivityFrames::numBins);
+
+    if (nextColumn > 0)
+    { g.drawImage(raster, split, 0, width - split, height, 0, 0, nextColumn, ActivityFrames::numBins); }
+}
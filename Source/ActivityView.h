@@ -0,0 +1,74 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+
+//==============================================================================
+/*
+    Hands the latest activity frame from the audio thread to the GUI without
+    either side ever waiting. Writer and reader each own one of three frames
+    and swap it with the spare one, so the reader always sees the most recent
+    complete frame and frames it was too slow for are simply skipped.
+*/
+class ActivityFrames
+{
+public:
+    static constexpr int numBins = 256;
+    using Frame                  = std::array<float, numBins>;
+
+    // Audio thread: fill the write frame, then publish it
+    Frame& getWriteFrame() { return frames[writeIndex]; }
+    void publish() { writeIndex = spare.exchange(writeIndex | freshFlag, std::memory_order_acq_rel) & indexMask; }
+
+    // GUI thread: the newest frame, or nullptr if nothing was published since the last call
+    Frame const* getLatestFrame()
+    {
+        if ((spare.load(std::memory_order_relaxed) & freshFlag) == 0) { return nullptr; }
+
+        readIndex = spare.exchange(readIndex, std::memory_order_acq_rel) & indexMask;
+        return &frames[readIndex];
+    }
+
+private:
+    static constexpr int freshFlag = 4;
+    static constexpr int indexMask = 3;
+
+    Frame frames[3] {};
+    int writeIndex {0};
+    alignas(64) std::atomic<int> spare {1};
+    alignas(64) int readIndex {2};
+};
+
+//==============================================================================
+/*
+    A scrolling raster of neuron activity: time runs from left to right, the
+    neurons are binned from bottom to top and the brightness shows the peak
+    envelope gain in each bin.
+
+    The raster is a small software Image; every timer tick writes one column
+    into it at a circular position and paint() only scales the two halves into
+    place, so monitoring stays cheap however many neurons are playing.
+*/
+class ActivityView
+    : public Component
+    , private Timer
+{
+public:
+    static constexpr int historyLength   = 256;
+    static constexpr int framesPerSecond = 30;
+
+    explicit ActivityView(ActivityFrames& frames);
+    ~ActivityView() override;
+
+    void paint(Graphics& g) override;
+
+private:
+    void timerCallback() override;
+
+    ActivityFrames& frames;
+    Image raster;
+    int nextColumn {};
+    std::array<Colour, 256> palette;
+};
@@ -0,0 +1,114 @@
+#include "EnvelopeBank.h"
+
+#include <cmath>
+
+void EnvelopeBank::reset()
+{
+    gains.fill(defaultGain);
+    pending.fill(0.f);
+    holds.fill(0.f);
+    update();
+}
+
+void EnvelopeBank::silence(int firstVoice, int endVoice)
+{
+    firstVoice = juce::jlimit(0, maxNumVoices, firstVoice);
+    endVoice   = juce::jlimit(firstVoice, maxNumVoices, endVoice);
+
+    std::fill(gains.begin() + firstVoice, gains.begin() + endVoice, 0.f);
+    std::fill(pending.begin() + firstVoice, pending.begin() + endVoice, 0.f);
+    std::fill(holds.begin() + firstVoice, holds.begin() + endVoice, 0.f);
+}
+
+void EnvelopeBank::setShape(int population, ShapeParameters const& parameters)
+{
+    jassert(population >= 0 && population < maxNumPopulations);
+    shapes[static_cast<size_t>(population)] = parameters;
+}
+
+void EnvelopeBank::assignPopulation(int firstVoice, int endVoice, int population)
+{
+    jassert(population >= 0 && population < maxNumPopulations);
+
+    firstVoice = juce::jlimit(0, maxNumVoices, firstVoice);
+    endVoice   = juce::jlimit(firstVoice, maxNumVoices, endVoice);
+    std::fill(populations.begin() + firstVoice, populations.begin() + endVoice, static_cast<uint8_t>(population));
+}
+
+void EnvelopeBank::update()
+{
+    restRise = static_cast<float>(defaultGain / (fadeInSeconds * sampleRate));
+
+    for (size_t i = 0; i < shapes.size(); i++) { coefficients[i] = makeCoefficients(shapes[i]); }
+}
+
+void EnvelopeBank::trigger(int index, float weight)
+{
+    auto const& c = getCoefficients(index);
+
+    // The pending gain of a voice never adds up to more than the gain limit at its peak
+    auto const headroom = std::max(0.f, (getGainLimit(index) - gains[index]) * c.peakScale);
+    auto const added    = pending[index] + weight * addGain * c.peakScale;
+
+    if (added > headroom) { DBG("Neuron peaked"); }
+
+    pending[index] = std::min(added, headroom);
+    holds[index]   = c.holdSamples;
+}
+
+void EnvelopeBank::trigger(int const* indices, float const* weights, int numSpikes)
+{
+    // The scatter stays one spike at a time, a vector scatter would lose all
+    // but one of the spikes that hit the same voice in a block
+    for (int i = 0; i < numSpikes; i++) { trigger(indices[i], weights[i]); }
+}
+
+EnvelopeBank::Coefficients EnvelopeBank::makeCoefficients(ShapeParameters const& parameters) const
+{
+    auto const toSamples = [this](float ms) { return std::max(1.f, static_cast<float>(ms * 0.001 * sampleRate)); };
+
+    // Exponential: everything pending arrives at once and nothing is ever held
+    Coefficients c {1.0e9f, 0.f, 1.f, 1.f, defaultGain, 0.f, 1.f};
+
+    switch (parameters.shape)
+    {
+        case Shape::exponential: break;
+
+        case Shape::attackRamp: c.rampRate = addGain / toSamples(parameters.attackMs); break;
+
+        case Shape::alpha:
+        {
+            // Pending gain leaks into the gain while both decay, a difference of
+            // two exponentials. Scaled so the peak reaches addGain.
+            auto const keep  = std::exp(-1.0 / toSamples(parameters.attackMs));
+            auto decay       = static_cast<double>(decayFactor);
+
+            // Equal constants are the limit of the formula below, a hair apart is close enough
+            if (std::abs(decay - keep) < 1.0e-7) { decay = keep - 1.0e-7; }
+
+            auto const peakN = std::log(std::log(keep) / std::log(decay)) / std::log(decay / keep);
+            auto const peak  = (1.0 - keep) * decay * (std::pow(decay, peakN) - std::pow(keep, peakN)) / (decay - keep);
+
+            c.rampRate     = 0.f;
+            c.transfer     = static_cast<float>(1.0 - keep);
+            c.attackFactor = decayFactor;
+            c.peakScale    = peak > 1.0e-6 ? static_cast<float>(1.0 / peak) : 1.f;
+            break;
+        }
+
+        case Shape::adsr:
+        {
+            auto const attack  = toSamples(parameters.attackMs);
+            auto const decay   = toSamples(parameters.decayMs);
+            auto const sustain = juce::jlimit(0.001f, 1.f, parameters.sustainLevel);
+
+            c.rampRate    = addGain / attack;
+            c.holdFactor  = std::pow(sustain, 1.f / decay);
+            c.holdFloor   = std::max(defaultGain, sustain * addGain);
+            c.holdSamples = attack + decay + toSamples(parameters.sustainMs);
+            break;
+        }
+    }
+
+    return c;
+}
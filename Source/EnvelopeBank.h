@@ -0,0 +1,168 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+//==============================================================================
+/*
+    The amplitude envelopes of all voices. Every voice belongs to one of a few
+    populations, and every population has its own shape:
+
+        exponential   the spike jumps the gain up, then it decays
+        attackRamp    the gain ramps up linearly over the attack time instead
+        alpha         a smooth rise and fall, t * exp(-t) for equal constants
+        adsr          ramp up, decay to a sustain level, hold it, release
+
+    All shapes are the same three numbers per voice, stored as plain arrays:
+    the gain, the part of the spike that has not reached the gain yet, and how
+    many samples the voice is still held at its sustain level. A population is
+    nothing but the coefficients that move gain between them, so one sample of
+    any shape is the same short run of min, max and selects, and a few voices
+    can be advanced side by side in vector registers without a state machine.
+
+    Once a voice has taken in its spike and is no longer held, it decays like
+    the plain exponential envelope did, see isSettled(). The renderer uses the
+    cheaper next(float) for those voices, which is nearly all of them.
+
+    A voice below the resting gain rises to it over fadeInSeconds, so voices
+    that are silenced when they are added fade in instead of popping up, and
+    raising defaultGain glides rather than jumps.
+*/
+class EnvelopeBank
+{
+public:
+    static constexpr int maxNumVoices      = 20000;
+    static constexpr int maxNumPopulations = 4;
+    static constexpr double fadeInSeconds  = 0.05;
+
+    enum class Shape
+    {
+        exponential,
+        attackRamp,
+        alpha,
+        adsr
+    };
+
+    struct ShapeParameters
+    {
+        Shape shape {Shape::exponential};
+        float attackMs {8.f};       // ramp length, or the rise time constant of alpha
+        float decayMs {60.f};       // adsr: from the peak down to the sustain level
+        float sustainLevel {0.4f};  // adsr: relative to addGain
+        float sustainMs {120.f};    // adsr: how long the sustain level is held
+    };
+
+    // Per population, derived from ShapeParameters and the gains below by update()
+    struct Coefficients
+    {
+        float rampRate;      // most of the pending gain that reaches the gain per sample
+        float transfer;      // fraction of the pending gain that reaches it per sample
+        float attackFactor;  // decay while pending gain is still coming in
+        float holdFactor;    // decay while held
+        float holdFloor;     // the level the gain is held at
+        float holdSamples;
+        float peakScale;     // pending gain per unit of peak gain
+    };
+
+    EnvelopeBank()
+    {
+        gainLimitScales.fill(1.f);
+        reset();
+    }
+
+    void prepare(double newSampleRate) { sampleRate = newSampleRate; }
+    void reset();
+
+    // Voices [firstVoice, endVoice) start from silence, to fade in
+    void silence(int firstVoice, int endVoice);
+
+    void setShape(int population, ShapeParameters const& parameters);
+    ShapeParameters const& getShape(int population) const { return shapes[static_cast<size_t>(population)]; }
+    void assignPopulation(int firstVoice, int endVoice, int population);
+
+    // Recomputes the coefficients, call once per block before triggering
+    void update();
+
+    // A spike of the given weight adds weight * addGain at its peak
+    void trigger(int index, float weight = 1.f);
+
+    // All spikes of a block at once; repeated indices add up like separate spikes
+    void trigger(int const* indices, float const* weights, int numSpikes);
+
+    // One sample of a resting or settled voice, written with selects so loops over many voices vectorise
+    float next(float g) const
+    {
+        auto const threshold = defaultGain + 0.01f;
+
+        g = g > threshold ? g * decayFactor : g;
+        g = g < defaultGain ? g + restRise : g;
+        return g < threshold && g > defaultGain ? defaultGain : g;
+    }
+
+    // numSamples samples of a settled voice at once, decayPower being decayFactor to the numSamples
+    float advance(float g, int numSamples, float decayPower) const
+    {
+        auto const threshold = defaultGain + 0.01f;
+
+        g = g > threshold ? g * decayPower : g;
+
+        if (g > threshold) { return g; }
+        return std::min(g + restRise * static_cast<float>(numSamples), defaultGain);
+    }
+
+    // One sample of any voice, again only selects and min/max
+    void next(float& gain, float& pendingGain, float& hold, Coefficients const& c) const
+    {
+        auto const step = pendingGain < 0.001f ? pendingGain
+                                               : std::min(pendingGain, c.rampRate + pendingGain * c.transfer);
+        gain += step;
+        pendingGain -= step;
+
+        auto const attacking = pendingGain > 0.f;
+        auto const held      = hold > 0.f;
+        auto const factor    = attacking ? c.attackFactor : (held ? c.holdFactor : decayFactor);
+        auto const floor     = held ? c.holdFloor : defaultGain;
+        auto const threshold = floor + 0.01f;
+
+        gain = gain > threshold ? gain * factor : gain;
+        gain = !attacking && !held && gain < floor ? gain + restRise : gain;
+        gain = !attacking && gain < threshold && gain > floor ? floor : gain;
+        hold = std::max(hold - 1.f, 0.f);
+    }
+
+    bool isSettled(int index) const { return pending[index] == 0.f && holds[index] == 0.f; }
+    Coefficients const& getCoefficients(int index) const { return coefficients[populations[index]]; }
+
+    float getGain(int index) const { return gains[index]; }
+    float getPendingGain(int index) const { return pending[index]; }
+    float* getGains() { return gains.data(); }
+    float* getPendingGains() { return pending.data(); }
+    float* getHolds() { return holds.data(); }
+    float getGainLimit(int index) const { return gainLimit * gainLimitScales[index]; }
+
+    // A voice that stands in for several neurons may rise as high as all of them together
+    void setGainLimitScale(int index, float scale) { gainLimitScales[index] = scale; }
+
+    float defaultGain {0.f};
+    float addGain {1.3f};
+    float decayFactor {0.99996f};
+
+private:
+    Coefficients makeCoefficients(ShapeParameters const& parameters) const;
+
+    double sampleRate {44100.0};
+    float gainLimit {12.f};
+    float restRise {};
+
+    std::array<ShapeParameters, maxNumPopulations> shapes {};
+    std::array<Coefficients, maxNumPopulations> coefficients {};
+
+    std::array<float, maxNumVoices> gains {};
+    std::array<float, maxNumVoices> pending {};
+    std::array<float, maxNumVoices> holds {};
+    std::array<uint8_t, maxNumVoices> populations {};
+    std::array<float, maxNumVoices> gainLimitScales {};
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+
+//==============================================================================
+/*
+    xoshiro128+ with several independent lanes kept side by side, so that bulk
+    generation runs as plain loops over small arrays which the compiler turns
+    into vector code. Unlike rand() it has no shared state and no locks, and
+    the same seed always reproduces the same sequence.
+*/
+class FastRandom
+{
+public:
+    static constexpr int numLanes = 8;
+
+    explicit FastRandom(uint64_t seed = 0x853c49e6748fea9bull) { setSeed(seed); }
+
+    void setSeed(uint64_t seed)
+    {
+        // splitmix64 expands the single seed into decorrelated lane states
+        for (int lane = 0; lane < numLanes; lane++)
+        {
+            for (int word = 0; word < 4; word++)
+            {
+                seed += 0x9e3779b97f4a7c15ull;
+                uint64_t z = seed;
+                z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z          = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                z          = z ^ (z >> 31);
+
+                state[word][lane] = static_cast<uint32_t>(z >> 32) | 1u;
+            }
+        }
+
+        nextLane = 0;
+    }
+
+    // Scalar access, cycles through the lanes
+    uint32_t nextUint32()
+    {
+        if (nextLane == 0) { step(); }
+
+        auto const r = buffered[nextLane];
+        nextLane     = (nextLane + 1) % numLanes;
+        return r;
+    }
+
+    // Uniform in [0, 1)
+    float nextFloat() { return static_cast<float>(nextUint32() >> 8) * (1.f / 16777216.f); }
+
+    // Uniform in [0, range)
+    int nextInt(int range) { return static_cast<int>((static_cast<uint64_t>(nextUint32()) * range) >> 32); }
+
+    // Writes numValues raw 32 bit values into dest
+    void fill(uint32_t* dest, int numValues)
+    {
+        int i    = 0;
+        nextLane = 0;
+
+        for (; i + numLanes <= numValues; i += numLanes)
+        {
+            step();
+
+            for (int lane = 0; lane < numLanes; lane++) { dest[i + lane] = buffered[lane]; }
+        }
+
+        for (; i < numValues; i++) { dest[i] = nextUint32(); }
+    }
+
+    // Writes numValues uniformly distributed integers in [0, range) into dest
+    void fillIndices(int* dest, int numValues, int range)
+    {
+        auto const scale = static_cast<float>(range) * (1.f / 16777216.f);
+        int i            = 0;
+        nextLane         = 0;
+
+        for (; i + numLanes <= numValues; i += numLanes)
+        {
+            step();
+
+            for (int lane = 0; lane < numLanes; lane++)
+            { dest[i + lane] = static_cast<int>(static_cast<float>(buffered[lane] >> 8) * scale); }
+        }
+
+        for (; i < numValues; i++) { dest[i] = nextInt(range); }
+    }
+
+private:
+    static uint32_t rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+
+    // Advances all lanes by one step and leaves their outputs in buffered
+    void step()
+    {
+        for (int lane = 0; lane < numLanes; lane++)
+        {
+            auto const s0 = state[0][lane];
+            auto const s1 = state[1][lane];
+            auto s2       = state[2][lane];
+            auto s3       = state[3][lane];
+
+            buffered[lane] = s0 + s3;
+
+            auto const t = s1 << 9;
+            s2 ^= s0;
+            s3 ^= s1;
+
+            state[1][lane] = s1 ^ s2;
+            state[0][lane] = s0 ^ s3;
+            state[2][lane] = s2 ^ t;
+            state[3][lane] = rotl(s3, 11);
+        }
+    }
+
+    uint32_t state[4][numLanes] {};
+    uint32_t buffered[numLanes] {};
+    int nextLane {};
+};
@@ -0,0 +1,112 @@
+#include "FrequencyIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+float FrequencyIndex::parseToleranceCents(juce::String const& commandLine)
+{
+    float tolerance = 0.f;
+
+    for (auto const& argument : juce::StringArray::fromTokens(commandLine, " ", "\""))
+    {
+        if (argument == "--no-merge") { return -1.f; }
+
+        if (argument.startsWith("--merge-cents="))
+        { tolerance = juce::jlimit(0.f, 1200.f, argument.fromFirstOccurrenceOf("=", false, false).getFloatValue()); }
+    }
+
+    return tolerance;
+}
+
+FrequencyIndex::FrequencyIndex()
+    : slots(maxNumNeurons, 0)
+    , slotFrequencies(maxNumNeurons, 0.f)
+    , slotSizes(maxNumNeurons, 0)
+{
+}
+
+void FrequencyIndex::build(float const* frequencies, int newNumNeurons, float toleranceCents)
+{
+    clear();
+    if (toleranceCents < 0.f || newNumNeurons <= 0) { return; }
+
+    numNeurons   = std::min(newNumNeurons, maxNumNeurons);
+    slotSizes[0] = 0;
+
+    // Anything that is not a frequency sorts first and stays with its equals
+    auto const frequencyOf = [frequencies](int neuron) {
+        auto const frequency = frequencies[neuron];
+        return std::isfinite(frequency) ? frequency : 0.f;
+    };
+
+    std::vector<int> order(static_cast<size_t>(numNeurons));
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return frequencyOf(a) < frequencyOf(b); });
+
+    // Halfway in cents, and exactly the frequency of a slot whose neurons all share it
+    auto const centreOf = [](float lowest, float highest) {
+        return highest > lowest && lowest > 0.f ? std::sqrt(lowest * highest) : lowest;
+    };
+
+    auto const ratio = std::exp2(toleranceCents / 1200.f);
+    auto lowest      = frequencyOf(order[0]);
+    auto highest     = lowest;
+
+    for (auto const neuron : order)
+    {
+        auto const frequency = frequencyOf(neuron);
+
+        if (frequency > std::max(lowest, lowest * ratio))
+        {
+            slotFrequencies[static_cast<size_t>(numSlots++)] = centreOf(lowest, highest);
+            slotSizes[static_cast<size_t>(numSlots)]         = 0;
+            lowest                                           = frequency;
+        }
+
+        highest                            = frequency;
+        slots[static_cast<size_t>(neuron)] = numSlots;
+        slotSizes[static_cast<size_t>(numSlots)]++;
+    }
+
+    slotFrequencies[static_cast<size_t>(numSlots++)] = centreOf(lowest, highest);
+
+    DBG("Merged " << numNeurons << " neurons into " << numSlots << " oscillators");
+}
+
+void FrequencyIndex::clear()
+{
+    numNeurons = 0;
+    numSlots   = 0;
+}
+
+void FrequencyIndex::copyFrom(FrequencyIndex const& other)
+{
+    numNeurons = other.numNeurons;
+    numSlots   = other.numSlots;
+
+    std::copy(other.slots.begin(), other.slots.begin() + numNeurons, slots.begin());
+    std::copy(other.slotFrequencies.begin(), other.slotFrequencies.begin() + numSlots, slotFrequencies.begin());
+    std::copy(other.slotSizes.begin(), other.slotSizes.begin() + numSlots, slotSizes.begin());
+}
+
+//==============================================================================
+int MergedSpikeSource::pullWeightedSpikes(int numSamples, int numSlots, int* dest, float* weights, int maxSpikes)
+{
+    if (source == nullptr || index == nullptr) { return 0; }
+
+    auto const numPulled = source->pullWeightedSpikes(numSamples, index->getNumNeurons(), dest, weights, maxSpikes);
+    int numKept          = 0;
+
+    for (int i = 0; i < numPulled; i++)
+    {
+        auto const slot = index->getSlot(dest[i]);
+        if (slot >= numSlots) { continue; }
+
+        dest[numKept] = slot;
+        if (weights != nullptr) { weights[numKept] = weights[i]; }
+        numKept++;
+    }
+
+    return numKept;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "SpikeSource.h"
+#include <JuceHeader.h>
+
+#include <vector>
+
+//==============================================================================
+/*
+    Maps the neurons of a UDP initialisation to oscillator slots, one slot per
+    distinct frequency. Simulators often quantise their neurons to a scale, so
+    thousands of neurons may share a few hundred frequencies; merged, each of
+    those frequencies is one oscillator instead of one per neuron.
+
+    Neurons merge when their frequencies lie within toleranceCents of the
+    lowest frequency of the slot, which then plays halfway between its lowest
+    and highest member; with a tolerance of 0 only equal frequencies merge and
+    every slot plays exactly the frequency of its neurons. Slots are numbered
+    from the lowest frequency up.
+
+    A merged slot has one phase and one envelope, and every spike of any of
+    its neurons triggers that envelope. For the exponential shape the slot's
+    gain is then the sum of its neurons' gains, so the output is the same as
+    with one voice per neuron started in phase, as long as the slot's gain
+    limit is scaled by its size (see EnvelopeBank::setGainLimitScale()); only
+    the resting gain applies once per slot rather than once per neuron.
+
+    build() allocates and sorts, so it runs wherever the initialisation is
+    received. An index is sized for maxNumNeurons up front, so copyFrom()
+    never allocates and the audio thread can keep a copy of its own.
+*/
+class FrequencyIndex
+{
+public:
+    static constexpr int maxNumNeurons = 65535;
+
+    // From --merge-cents=N, 0 without it, and negative with --no-merge
+    static float parseToleranceCents(juce::String const& commandLine);
+
+    FrequencyIndex();
+
+    // A negative tolerance leaves the index empty, nothing is merged then
+    void build(float const* frequencies, int numNeurons, float toleranceCents);
+    void clear();
+    void copyFrom(FrequencyIndex const& other);
+
+    int getNumNeurons() const { return numNeurons; }
+    int getNumSlots() const { return numSlots; }
+    int getSlot(int neuron) const { return slots[static_cast<size_t>(neuron)]; }
+    float getSlotFrequency(int slot) const { return slotFrequencies[static_cast<size_t>(slot)]; }
+    int getSlotSize(int slot) const { return slotSizes[static_cast<size_t>(slot)]; }
+
+private:
+    std::vector<int> slots;
+    std::vector<float> slotFrequencies;
+    std::vector<int> slotSizes;
+    int numNeurons {};
+    int numSlots {};
+};
+
+//==============================================================================
+/*
+    Passes on the spikes of a source with every neuron replaced by its slot in
+    a FrequencyIndex.
+*/
+class MergedSpikeSource : public SpikeSource
+{
+public:
+    // Call before every render
+    void setSource(SpikeSource& newSource, FrequencyIndex const& newIndex)
+    {
+        source = &newSource;
+        index  = &newIndex;
+    }
+
+    int pullSpikes(int numSamples, int numSlots, int* dest, int maxSpikes) override
+    {
+        return pullWeightedSpikes(numSamples, numSlots, dest, nullptr, maxSpikes);
+    }
+
+    int pullWeightedSpikes(int numSamples, int numSlots, int* dest, float* weights, int maxSpikes) override;
+
+private:
+    SpikeSource* source {};
+    FrequencyIndex const* index {};
+};
@@ -0,0 +1,131 @@
+#include "LoadGovernor.h"
+
+#include <algorithm>
+#include <cmath>
+
+char const* LoadGovernor::getTierName(Tier tier)
+{
+    switch (tier)
+    {
+        case Tier::full: return "full";
+        case Tier::stealing: return "stealing";
+        case Tier::blockEnvelopes: return "block envelopes";
+        case Tier::compactVoices: return "compact voices";
+    }
+
+    return "";
+}
+
+void LoadGovernor::prepare(double sampleRate)
+{
+    secondsPerSample = 1.0 / sampleRate;
+    reset();
+}
+
+void LoadGovernor::reset()
+{
+    smoothedLoad        = 0.f;
+    secondsSinceChange  = 0.0;
+    secondsWithHeadroom = 0.0;
+    voiceShare          = 1.f;
+    setTier(Tier::full, 0.f);
+}
+
+void LoadGovernor::update(double renderSeconds, int numSamples)
+{
+    if (numSamples <= 0) { return; }
+
+    auto const blockSeconds = numSamples * secondsPerSample;
+    auto const load         = static_cast<float>(renderSeconds / blockSeconds);
+    auto const smoothing    = static_cast<float>(1.0 - std::exp(-blockSeconds / loadSeconds));
+
+    smoothedLoad += (load - smoothedLoad) * smoothing;
+    secondsSinceChange += blockSeconds;
+    secondsWithHeadroom = smoothedLoad < headroomLoad ? secondsWithHeadroom + blockSeconds : 0.0;
+
+    // An overrun cannot wait for the average, but every step gets time to show its effect first
+    if ((smoothedLoad > pressureLoad || load > 1.f) && secondsSinceChange >= settleSeconds)
+    {
+        degrade(std::max(load, smoothedLoad));
+        return;
+    }
+
+    if (secondsWithHeadroom >= recoverSeconds)
+    {
+        restore(smoothedLoad);
+        secondsWithHeadroom = 0.0;
+    }
+}
+
+void LoadGovernor::degrade(float load)
+{
+    secondsSinceChange = 0.0;
+
+    switch (tier)
+    {
+        case Tier::full:
+            voiceShare = shareStep;
+            setTier(Tier::stealing, load);
+            break;
+
+        case Tier::stealing:
+            if (voiceShare > minVoiceShare)
+            {
+                voiceShare = std::max(minVoiceShare, voiceShare * shareStep);
+                reportedShare.store(voiceShare, std::memory_order_relaxed);
+            }
+            else
+            {
+                setTier(Tier::blockEnvelopes, load);
+            }
+            break;
+
+        case Tier::blockEnvelopes: setTier(Tier::compactVoices, load); break;
+
+        // Nothing cheaper is left, the device will have to drop blocks
+        case Tier::compactVoices: break;
+    }
+}
+
+void LoadGovernor::restore(float load)
+{
+    secondsSinceChange = 0.0;
+
+    switch (tier)
+    {
+        case Tier::full: break;
+
+        case Tier::stealing:
+            voiceShare = std::min(1.f, voiceShare / shareStep);
+
+            if (voiceShare > 0.99f)
+            {
+                voiceShare = 1.f;
+                setTier(Tier::full, load);
+            }
+            else
+            {
+                reportedShare.store(voiceShare, std::memory_order_relaxed);
+            }
+            break;
+
+        case Tier::blockEnvelopes: setTier(Tier::stealing, load); break;
+        case Tier::compactVoices: setTier(Tier::blockEnvelopes, load); break;
+    }
+}
+
+void LoadGovernor::setTier(Tier newTier, float load)
+{
+    auto const oldTier = tier;
+    tier               = newTier;
+
+    reportedTier.store(static_cast<int>(newTier), std::memory_order_relaxed);
+    reportedShare.store(voiceShare, std::memory_order_relaxed);
+
+    if (newTier == oldTier) { return; }
+
+    numChanges.fetch_add(1, std::memory_order_relaxed);
+
+    // The queue is preallocated; if nobody has read it for a while, the oldest changes are what counts
+    changes.try_enqueue({oldTier, newTier, load});
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "readerwriterqueue.h"
+#include <JuceHeader.h>
+
+#include <atomic>
+
+//==============================================================================
+/*
+    Keeps the audio callback inside its deadline when the CPU cannot render
+    everything, by trading detail for time instead of letting the device drop
+    whole blocks.
+
+    The callback reports how long every block took. When the load, smoothed
+    over loadSeconds, passes pressureLoad, or a single block overruns, the
+    governor degrades one step, walking down the tiers:
+
+        full            everything, as configured
+        stealing        only the loudest voiceShare of the voices is rendered;
+                        the share shrinks step by step down to minVoiceShare
+        blockEnvelopes  settled voices step their gain once per tile
+        compactVoices   the compact layout, whose gains only move once per
+                        sub-block and whose voices are half the size
+
+    After a step it waits settleSeconds for the load to show the effect. Once
+    the load has stayed below headroomLoad for recoverSeconds it undoes the
+    last step, in the opposite order, and waits for the full recoverSeconds
+    again before the next one.
+
+    update() runs on the audio thread and neither allocates nor locks. Every
+    tier change is queued as a Change, for the message thread to report.
+*/
+class LoadGovernor
+{
+public:
+    static constexpr float pressureLoad    = 0.75f;
+    static constexpr float headroomLoad    = 0.45f;
+    static constexpr float minVoiceShare   = 0.4f;
+    static constexpr float shareStep       = 0.8f;
+    static constexpr double loadSeconds    = 0.02;
+    static constexpr double settleSeconds  = 0.1;
+    static constexpr double recoverSeconds = 2.0;
+    static constexpr int maxQueuedChanges  = 64;
+
+    enum class Tier
+    {
+        full,
+        stealing,
+        blockEnvelopes,
+        compactVoices
+    };
+
+    struct Change
+    {
+        Tier from;
+        Tier to;
+        float load;
+    };
+
+    static char const* getTierName(Tier tier);
+
+    void prepare(double sampleRate);
+    void reset();
+
+    // Called after every block with the time it took to render numSamples samples
+    void update(double renderSeconds, int numSamples);
+
+    // What the next block should be rendered with
+    Tier getTier() const { return tier; }
+    float getVoiceShare() const { return voiceShare; }
+    bool useBlockRateEnvelopes() const { return tier >= Tier::blockEnvelopes; }
+    bool useCompactVoices() const { return tier >= Tier::compactVoices; }
+
+    // Safe to read from any thread
+    int getReportedTier() const { return reportedTier.load(std::memory_order_relaxed); }
+    float getReportedVoiceShare() const { return reportedShare.load(std::memory_order_relaxed); }
+    uint64_t getNumChanges() const { return numChanges.load(std::memory_order_relaxed); }
+
+    // Message thread only, takes the oldest change not reported yet
+    bool popChange(Change& change) { return changes.try_dequeue(change); }
+
+private:
+    void degrade(float load);
+    void restore(float load);
+    void setTier(Tier newTier, float load);
+
+    double secondsPerSample {1.0 / 44100.0};
+    float smoothedLoad {};
+    double secondsSinceChange {};
+    double secondsWithHeadroom {};
+
+    Tier tier {Tier::full};
+    float voiceShare {1.f};
+
+    moodycamel::ReaderWriterQueue<Change> changes {maxQueuedChanges};
+    std::atomic<int> reportedTier {0};
+    std::atomic<float> reportedShare {1.f};
+    std::atomic<uint64_t> numChanges {0};
+};
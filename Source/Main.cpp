@@ -14,13 +14,24 @@ public:
     bool moreThanOneInstanceAllowed() override { return true; }
 
     //==============================================================================
-    void initialise(const String& commandLine) override { mainWindow.reset(new MainWindow(getApplicationName())); }
+    void initialise(const String& commandLine) override
+    {
+        // A headless render node runs without a window until its process is terminated
+        if (ClusterSettings::parseCommandLine(commandLine).headless)
+        {
+            headlessComponent = std::make_unique<MainComponent>(commandLine);
+            return;
+        }
+
+        mainWindow.reset(new MainWindow(getApplicationName(), commandLine));
+    }
 
     void shutdown() override
     {
         // Add your application's shutdown code here..
 
-        mainWindow = nullptr;  // (deletes our window)
+        mainWindow        = nullptr;  // (deletes our window)
+        headlessComponent = nullptr;
     }
 
     //==============================================================================
@@ -36,13 +47,13 @@ public:
     class MainWindow : public DocumentWindow
     {
     public:
-        MainWindow(String name)
+        MainWindow(String name, String const& commandLine)
             : DocumentWindow(
                 name, Desktop::getInstance().getDefaultLookAndFeel().findColour(ResizableWindow::backgroundColourId),
                 DocumentWindow::allButtons)
         {
             setUsingNativeTitleBar(true);
-            setContentOwned(new MainComponent(), true);
+            setContentOwned(new MainComponent(commandLine), true);
 
 #if JUCE_IOS || JUCE_ANDROID
             setFullScreen(true);
@@ -69,6 +80,7 @@ public:
 
 private:
     std::unique_ptr<MainWindow> mainWindow;
+    std::unique_ptr<MainComponent> headlessComponent;
 };
 
 //==============================================================================
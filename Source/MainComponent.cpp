@@ -3,118 +3,56 @@
 
 #include <cstdint>
 
-MainComponent::MainComponent()
-    : udpThread([this]() {
-        udp.bindToPort(portNumber, "0.0.0.0");
-
-        // while(true){
+namespace
+{
+File getSpikeLogDirectory()
+{
+    return File::getSpecialLocation(File::userDocumentsDirectory).getChildFile(ProjectInfo::projectName);
+}
 
-        DBG("UDP Thread waiting for connection");
+// Menu ids are the EnvelopeBank::Shape values plus one
+void addEnvelopeShapes(ComboBox& box, String const& name)
+{
+    box.addItem(name + ": exponential", 1 + static_cast<int>(EnvelopeBank::Shape::exponential));
+    box.addItem(name + ": attack ramp", 1 + static_cast<int>(EnvelopeBank::Shape::attackRamp));
+    box.addItem(name + ": alpha", 1 + static_cast<int>(EnvelopeBank::Shape::alpha));
+    box.addItem(name + ": ADSR", 1 + static_cast<int>(EnvelopeBank::Shape::adsr));
+    box.setSelectedId(1, dontSendNotification);
+}
 
-        auto status = udp.waitUntilReady(true, -1);
+EnvelopeBank::ShapeParameters getEnvelopeShape(ComboBox const& box)
+{
+    EnvelopeBank::ShapeParameters parameters;
+    parameters.shape = static_cast<EnvelopeBank::Shape>(jlimit(0, 3, box.getSelectedId() - 1));
+    return parameters;
+}
+}  // namespace
 
-        if (status == 0) { DBG("Connection Time Out"); }
-        if (status == -1) { DBG("Error connecting to UDP Port"); }
+MainComponent::MainComponent(String const& commandLine)
+{
+    threadTuning.parseCommandLine(commandLine);
+    cluster = ClusterSettings::parseCommandLine(commandLine);
 
-        if (status == 1)
-        {
-            while (true)
-            {
-                uint8_t buffer[5000] = {};
-                auto const numBytes  = udp.read(static_cast<void*>(buffer), sizeof(buffer), false);
-
-                if (numBytes > 0)
-                {
-                    MessageType type = MessageType::Unknown;
-                    std::memcpy(&type, &buffer, sizeof(MessageType));
-
-                    switch (type)
-                    {
-                        case MessageType::Performance:
-                        {
-                            auto msg = PerformanceMessage {};
-                            std::memcpy(&msg.index, buffer + 1, sizeof(PerformanceMessage::index));
-                            // DBG("UDP Thread:");
-                            // DBG(msg.index);
-                            queue.enqueue(msg.index);
-
-                            break;
-                        }
-
-                        case MessageType::Initialisation:
-                        {
-                            systemIsInInitMode.store(true);
-                            listOfFrequencies.clear();
-
-                            std::memcpy(&numFrequenciesReceived, buffer + 1, 2);
-                            std::memcpy(&chunkSize, buffer + 3, 2);
-
-                            DBG("Initialisation Begin.\nNum Neurons:");
-                            DBG(numFrequenciesReceived);
-                            DBG("chunk Size:");
-                            DBG(chunkSize);
-                            break;
-                        }
-
-                        case MessageType::InitialisationContent:
-                        {
-                            auto msg = InitialisationContentMessage {};
-
-                            for (int i = 1; i < chunkSize * 4; i = i + 4)
-                            {
-                                std::memcpy(&msg.frequency, buffer + i, 4);
-
-                                if (msg.frequency == 0)
-                                {
-                                    DBG("Initialisation Succesfull - 0 reached");
-                                    systemIsInInitMode.store(false);
-                                    break;
-                                }
-
-                                listOfFrequencies.push_back(msg.frequency);
-                                DBG(msg.frequency);
-                            }
-
-                            if (listOfFrequencies.size() == numFrequenciesReceived)
-                            {
-                                DBG("Initialisation Succesfull - vector filled");
-                                systemIsInInitMode.store(false);
-                                break;
-                            }
-
-                            if (listOfFrequencies.size() > numFrequenciesReceived)
-                            {
-                                DBG("Initialisation Overload");
-                                break;
-                            }
-                            if (listOfFrequencies.size() < numFrequenciesReceived)
-                            {
-                                DBG("chunk done, waiting for next one");
-                                DBG(listOfFrequencies.size());
-                                break;
-                            }
-                        }
-
-                        default: jassertfalse; break;
-                    }
-                }
-            }
-        }
-    })
+    // Shards number their voices by neuron, so only whole nodes merge neurons into shared voices
+    auto const mergeTolerance = FrequencyIndex::parseToleranceCents(commandLine);
+    udpInput.initialisation.mergeToleranceCents = cluster.isSharded() ? -1.f : mergeTolerance;
 
-{
     setSize(800, 600);
 
-    if (RuntimePermissions::isRequired(RuntimePermissions::recordAudio)
-        && !RuntimePermissions::isGranted(RuntimePermissions::recordAudio))
-    {
-        RuntimePermissions::request(RuntimePermissions::recordAudio, [&](bool granted) {
-            if (granted) setAudioChannels(2, 2);
-        });
-    }
-    else
+    // A headless node opens no device, headlessDriver drives it once everything is set up
+    if (!cluster.headless)
     {
-        setAudioChannels(2, 2);
+        if (RuntimePermissions::isRequired(RuntimePermissions::recordAudio)
+            && !RuntimePermissions::isGranted(RuntimePermissions::recordAudio))
+        {
+            RuntimePermissions::request(RuntimePermissions::recordAudio, [&](bool granted) {
+                if (granted) setAudioChannels(2, 2);
+            });
+        }
+        else
+        {
+            setAudioChannels(2, 2);
+        }
     }
 
     frequencySlider.setRange(20.0, 20000.0);
@@ -158,136 +96,418 @@ MainComponent::MainComponent()
     udpModeButton.setClickingTogglesState(true);
     addAndMakeVisible(udpModeButton);
 
+    networkButton.setButtonText("Run Spiking Network");
+    networkButton.setClickingTogglesState(true);
+    networkButton.onClick = [this] { toggleNetwork(networkButton.getToggleState()); };
+    addAndMakeVisible(networkButton);
+
+    recordButton.setButtonText("Record Spikes");
+    recordButton.setClickingTogglesState(true);
+    recordButton.onClick = [this] { toggleRecording(recordButton.getToggleState()); };
+    addAndMakeVisible(recordButton);
+
+    replayButton.setButtonText("Replay Spike Log");
+    replayButton.setClickingTogglesState(true);
+    replayButton.onClick = [this] { toggleReplay(replayButton.getToggleState()); };
+    addAndMakeVisible(replayButton);
+
+    oscButton.setButtonText("Listen for OSC on " + String(OscSpikeInput::defaultPort));
+    oscButton.setClickingTogglesState(true);
+    oscButton.onClick = [this] { toggleOsc(oscButton.getToggleState()); };
+    addAndMakeVisible(oscButton);
+
+    compactButton.setButtonText("Compact Voices");
+    compactButton.setClickingTogglesState(true);
+    addAndMakeVisible(compactButton);
+
+    // Without the network every voice uses the first envelope
+    addEnvelopeShapes(envelopeBox, "Envelope");
+    addAndMakeVisible(envelopeBox);
+
+    addEnvelopeShapes(inhibitoryEnvelopeBox, "Inhibitory");
+    addAndMakeVisible(inhibitoryEnvelopeBox);
+
+    replaySpeedSlider.setRange(1.0, 32.0);
+    replaySpeedSlider.setSkewFactorFromMidPoint(4.0);
+    replaySpeedSlider.setValue(1.0);
+    replaySpeedSlider.onValueChange = [this] { replay.setSpeed(replaySpeedSlider.getValue()); };
+    addAndMakeVisible(replaySpeedSlider);
+
     portNumberEditor.setMultiLine(false);
     portNumberEditor.setEscapeAndReturnKeysConsumed(true);
     portNumberEditor.setCaretVisible(true);
+    portNumberEditor.setText(cluster.spikePorts.isNotEmpty() ? cluster.spikePorts : String(UdpSpikeInput::defaultPort),
+                             false);
+    portNumberEditor.onReturnKey = [this] { applyPorts(); };
     addAndMakeVisible(portNumberEditor);
+
+    addAndMakeVisible(statusLabel);
+    addAndMakeVisible(activityView);
+
+    applyPorts();
+
+    registerMetrics();
+
+    // A node either sends its shard to a mixer or plays, and then may mix other shards in
+    auto clusterResult = Result::ok();
+
+    if (cluster.mixerPort > 0)
+    {
+        auto const format = cluster.rtp ? ShardSender::Format::rtp : ShardSender::Format::cells;
+        clusterResult     = shardSender.start(cluster.mixerHost, cluster.mixerPort, cluster.shardFirst, format);
+    }
+    else if (cluster.mixPort > 0)
+    { clusterResult = shardMixer.start(cluster.mixPort); }
+
+    clusterStatus = clusterResult.failed() ? clusterResult.getErrorMessage() : cluster.getDescription();
+
+    auto const metricsPort = MetricsServer::parsePort(commandLine);
+
+    if (metricsPort > 0)
+    {
+        auto const result = metrics.start(metricsPort);
+        metricsStatus     = result.failed() ? result.getErrorMessage() : "metrics on :" + String(metricsPort);
+    }
+
+    startTimerHz(2);
+
+    if (cluster.headless) { headlessDriver.start(*this, cluster.headlessRate, cluster.headlessBlockSize); }
 }
 
 MainComponent::~MainComponent()
 {
-    udp.shutdown();
-
-    if (udpThread.joinable()) { udpThread.join(); }
+    stopTimer();
+    headlessDriver.stop();
+    metrics.stop();
+    network.stop();
+    oscInput.stop();
+    udpInput.stop();
+    recorder.stop();
+    shardSender.stop();
+    shardMixer.stop();
 
     shutdownAudio();
 }
 
-void MainComponent::updateFrequency(float f, int index)
+void MainComponent::selectInternalSource(SpikeSource* source)
 {
-    frequency          = f;
-    increment          = frequency * waveTableSize / currentSampleRate;
-    phaseVector[index] = fmod((phaseVector[index] + increment), waveTableSize);
+    // The internal sources are exclusive, switching to one stops the others
+    internalSource.store(source);
+
+    if (source != &network)
+    {
+        networkButton.setToggleState(false, dontSendNotification);
+        network.stop();
+    }
+
+    if (source != &replay) { replayButton.setToggleState(false, dontSendNotification); }
+
+    if (source != &oscInput)
+    {
+        oscButton.setToggleState(false, dontSendNotification);
+        oscInput.stop();
+    }
 }
 
-void MainComponent::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+void MainComponent::toggleNetwork(bool shouldRun)
 {
-    phaseVector.reserve(maxNumOsc);
-    gainVector.reserve(1000);
-
-    phaseVector[0]    = 0;
-    frequency         = 440;
-    increment         = frequency * waveTableSize / sampleRate;
-    currentSampleRate = sampleRate;
+    if (!shouldRun)
+    {
+        selectInternalSource(&randomSpikes);
+        return;
+    }
 
-    fillBuffer.setSize(2, samplesPerBlockExpected);
+    auto parameters       = network.getParameters();
+    parameters.numNeurons = static_cast<int>(oscSlider.getValue());
 
-    for (int i = 0; i < waveTableSize; i++) { waveTable[i] = sin(2.f * double_Pi * i / waveTableSize); }
+    network.build(parameters);
+    network.start();
+    selectInternalSource(&network);
 }
 
-void MainComponent::getNextAudioBlock(const AudioSourceChannelInfo& bufferToFill)
+void MainComponent::toggleOsc(bool shouldListen)
 {
-    // prepare buffer
-    auto const buffer = bufferToFill.buffer;
-    buffer->clear();
+    if (!shouldListen)
+    {
+        oscInput.stop();
+        selectInternalSource(&randomSpikes);
+        return;
+    }
 
-    // get Slider values
-    bool udpMode        = udpModeButton.getToggleState();
-    float masterGain    = amplitudeSlider.getValue();
-    int numOSC          = udpMode ? numFrequenciesReceived : static_cast<int>(oscSlider.getValue());
-    float webDensity    = webSlider.getValue();
-    float highFrequency = highcutSlider.getValue();
-    float subFrequency  = std::floor(frequencySlider.getValue());
-    env.defaultGain     = noiseGainSlider.getValue();
-    env.addGain         = attackSlider.getValue();
-    env.decayFactor     = decaySlider.getValue();
-
-    // UDP Receive
-    spikingFrequencies.fill(-1);
+    auto const result = oscInput.start(OscSpikeInput::defaultPort);
 
-    if (udpMode)
+    if (result.failed())
     {
-        int udpReadIndex = 0;
+        DBG(result.getErrorMessage());
+        oscButton.setToggleState(false, dontSendNotification);
+        return;
+    }
+
+    selectInternalSource(&oscInput);
+}
 
-        while (queue.peek() != nullptr && udpReadIndex < maxIndexToReadUdpMessage)
+void MainComponent::registerMetrics()
+{
+    auto count = [](std::atomic<uint64_t> const& counter) {
+        return [&counter] { return static_cast<double>(counter.load(std::memory_order_relaxed)); };
+    };
+
+    metrics.addCounter("oscweb_audio_callbacks_total", "Audio callbacks rendered", count(numCallbacks));
+    metrics.addCounter("oscweb_audio_overruns_total", "Audio callbacks that took longer than their block",
+                       count(numOverruns));
+    metrics.addGauge("oscweb_audio_callback_load", "Smoothed callback time as a fraction of the block duration",
+                     [this] { return static_cast<double>(callbackLoad.load(std::memory_order_relaxed)); });
+    metrics.addGauge("oscweb_active_voices", "Voices rendered in the last callback",
+                     [this] { return static_cast<double>(numActiveVoices.load(std::memory_order_relaxed)); });
+    metrics.addCounter("oscweb_spikes_rendered_total", "Spikes that triggered a voice", count(numSpikesRendered));
+    metrics.addGauge("oscweb_stolen_voices", "Quiet voices skipped in the last callback to save time",
+                     [this] { return static_cast<double>(numStolenVoices.load(std::memory_order_relaxed)); });
+    metrics.addGauge("oscweb_governor_tier", "Rendering shortcuts taken under load, 0 for none, see LoadGovernor::Tier",
+                     [this] { return static_cast<double>(governor.getReportedTier()); });
+    metrics.addGauge("oscweb_governor_voice_share", "Share of the loudest voices rendered under load",
+                     [this] { return static_cast<double>(governor.getReportedVoiceShare()); });
+    metrics.addCounter("oscweb_governor_changes_total", "Times the governor changed its tier",
+                       [this] { return static_cast<double>(governor.getNumChanges()); });
+    metrics.addGauge("oscweb_output_gain_reduction_db", "Deepest limiter gain reduction in the last callback",
+                     [this] { return static_cast<double>(outputStage.getGainReductionDb()); });
+    metrics.addGauge("oscweb_output_normalisation_gain", "Gain applied to keep the expected level at the reference",
+                     [this] { return static_cast<double>(outputStage.getNormalisationGain()); });
+
+    metrics.addCounter("oscweb_udp_messages_total{type=\"performance\"}", "UDP datagrams received by type",
+                       [this] { return static_cast<double>(udpInput.getNumSpikesReceived()); });
+    metrics.addCounter("oscweb_udp_messages_total{type=\"initialisation\"}", "UDP datagrams received by type",
+                       [this] { return static_cast<double>(udpInput.getNumInitialisationMessages()); });
+    metrics.addCounter("oscweb_udp_messages_total{type=\"unknown\"}", "UDP datagrams received by type",
+                       [this] { return static_cast<double>(udpInput.getNumUnknownMessages()); });
+    metrics.addCounter("oscweb_udp_messages_total{type=\"malformed\"}", "UDP datagrams received by type",
+                       [this] { return static_cast<double>(udpInput.getNumMalformedMessages()); });
+    metrics.addCounter("oscweb_udp_spikes_dropped_total", "UDP spikes lost because a receive queue was full",
+                       [this] { return static_cast<double>(udpInput.getNumSpikesDropped()); });
+    metrics.addGauge("oscweb_udp_queue_depth", "UDP spikes waiting for the audio thread",
+                     [this] { return static_cast<double>(udpInput.getQueueDepth()); });
+
+    auto stream = [this](uint64_t StreamStats::*field) {
+        return [this, field] { return static_cast<double>(udpInput.getStreamStats().*field); };
+    };
+
+    metrics.addCounter("oscweb_udp_packets_total", "Versioned UDP packets received", stream(&StreamStats::numPackets));
+    metrics.addCounter("oscweb_udp_sequence_gaps_total", "Packets found missing in a sender's sequence",
+                       stream(&StreamStats::numGaps));
+    metrics.addCounter("oscweb_udp_reordered_total", "Packets that arrived after a later one",
+                       stream(&StreamStats::numReordered));
+    metrics.addCounter("oscweb_udp_duplicates_total", "Packets that arrived more than once",
+                       stream(&StreamStats::numDuplicates));
+    metrics.addHistogram("oscweb_udp_latency_seconds", "Receive time minus the sender's timestamp", [this] {
+        auto const stats = udpInput.getStreamStats();
+        MetricsServer::Histogram histogram;
+
+        for (int i = 0; i < StreamStats::numLatencyBuckets; i++)
         {
-            queue.try_dequeue(spikingFrequencies[udpReadIndex]);
+            if (i < StreamStats::numLatencyBuckets - 1)
+            { histogram.upperBounds.push_back(StreamStats::getBucketUpperBound(i)); }
 
-            udpReadIndex++;
+            histogram.counts.push_back(static_cast<double>(stats.latencyBuckets[static_cast<size_t>(i)]));
         }
-    }
-    else
-    {
-        int numCycles    = fmod(rand(), 10000);
-        int rndmIndex    = -1;
-        int indexCounter = 0;
 
-        for (int i = 0; i < numCycles; i++)
-        {
-            rndmIndex = fmod(rand(), 20000);
+        histogram.sum = stats.latencySumSeconds;
+        return histogram;
+    });
+
+    metrics.addCounter("oscweb_osc_malformed_packets_total", "OSC packets that could not be parsed",
+                       [this] { return static_cast<double>(oscInput.getNumMalformedPackets()); });
+    metrics.addCounter("oscweb_osc_spikes_dropped_total", "OSC spikes lost because the queue was full",
+                       [this] { return static_cast<double>(oscInput.getNumSpikesDropped()); });
+
+    auto const shardStream = [this](uint64_t StreamStats::*field) {
+        return [this, field] {
+            StreamStats stats;
+            shardMixer.addStreamStats(stats);
+            return static_cast<double>(stats.*field);
+        };
+    };
+
+    metrics.addCounter("oscweb_cluster_packets_sent_total", "Audio packets this render node sent to the mixer",
+                       [this] { return static_cast<double>(shardSender.getNumPacketsSent()); });
+    metrics.addCounter("oscweb_cluster_cells_dropped_total", "Rendered cells lost because the send queue was full",
+                       [this] { return static_cast<double>(shardSender.getNumCellsDropped()); });
+    metrics.addCounter("oscweb_cluster_resyncs_total", "Times a stream was placed anew on the wall clock", [this] {
+        return static_cast<double>(shardSender.getNumResyncs() + shardMixer.getNumResyncs());
+    });
+    metrics.addCounter("oscweb_cluster_packets_received_total", "Audio packets the mixer received from shards",
+                       [this] { return static_cast<double>(shardMixer.getNumPacketsReceived()); });
+    metrics.addCounter("oscweb_cluster_packets_late_total", "Audio packets that arrived after their time was played",
+                       [this] { return static_cast<double>(shardMixer.getNumLatePackets()); });
+    metrics.addCounter("oscweb_cluster_packets_rejected_total", "Datagrams on the mixer port that could not be mixed",
+                       [this] { return static_cast<double>(shardMixer.getNumRejectedPackets()); });
+    metrics.addCounter("oscweb_cluster_cells_missing_total", "Cells of active shards that were not there in time",
+                       [this] { return static_cast<double>(shardMixer.getNumMissingCells()); });
+    metrics.addCounter("oscweb_cluster_sequence_gaps_total", "Audio packets found missing in a shard's sequence",
+                       shardStream(&StreamStats::numGaps));
+    metrics.addGauge("oscweb_cluster_active_shards", "Shards the mixer received from in the last second",
+                     [this] { return static_cast<double>(shardMixer.getNumActiveShards()); });
+}
 
-            if (rndmIndex < numOSC)
-            {
-                spikingFrequencies[indexCounter] = rndmIndex;
+void MainComponent::applyPorts()
+{
+    // Rebinding only restarts the receiver threads, which wake up and exit immediately
+    auto const result = udpInput.setPorts(portNumberEditor.getText());
 
-                indexCounter++;
-            }
-        }
+    portStatus = result.failed() ? result.getErrorMessage() : "UDP input on " + portNumberEditor.getText();
+    timerCallback();
+}
+
+void MainComponent::toggleRecording(bool shouldRecord)
+{
+    if (!shouldRecord)
+    {
+        recorder.stop();
+        return;
     }
 
-    for (auto& f : spikingFrequencies)
+    auto const file = getSpikeLogDirectory().getChildFile(
+        "spikes-" + Time::getCurrentTime().formatted("%Y%m%d-%H%M%S") + SpikeLogFormat::fileExtension);
+    auto const result = recorder.start(file);
+
+    if (result.failed())
     {
-        if (f == -1) { break; }
-        env.trigger(f);
+        DBG(result.getErrorMessage());
+        recordButton.setToggleState(false, dontSendNotification);
     }
+}
 
-    // If the number of oscillators changed, delete old phases & envelope gains
-    bool numOscChanged = oldNumOsc != numOSC ? true : false;
-    if (numOscChanged)
+void MainComponent::toggleReplay(bool shouldReplay)
+{
+    if (!shouldReplay)
     {
-        phaseVector.clear();
-        env.reset();
+        selectInternalSource(&randomSpikes);
+        return;
     }
 
-    // oscillation:
-    for (int i = 0; i < numOSC; i++)
+    replayChooser = std::make_unique<FileChooser>("Choose a spike log", getSpikeLogDirectory(),
+                                                  String("*") + SpikeLogFormat::fileExtension);
+
+    replayChooser->launchAsync(FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles,
+                               [this](FileChooser const& chooser) {
+                                   auto const result = replay.load(chooser.getResult());
+
+                                   if (result.failed())
+                                   {
+                                       DBG(result.getErrorMessage());
+                                       replayButton.setToggleState(false, dontSendNotification);
+                                       return;
+                                   }
+
+                                   selectInternalSource(&replay);
+                               });
+}
+
+void MainComponent::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+{
+    audioThreadTuned.store(false);
+    synth.prepare(sampleRate);
+    outputStage.prepare(sampleRate);
+    governor.prepare(sampleRate);
+    shardSender.prepare(sampleRate);
+    shardMixer.prepare(sampleRate, cluster.jitterMs);
+    secondsPerSample = 1.0 / sampleRate;
+    samplesPerActivityFrame = static_cast<int>(sampleRate) / ActivityView::framesPerSecond;
+    randomSpikes.prepare(sampleRate, NeuronSynth::subBlockSize);
+    network.prepare(sampleRate, NeuronSynth::subBlockSize);
+    replay.prepare(sampleRate, NeuronSynth::subBlockSize);
+    oscInput.prepare(sampleRate, NeuronSynth::subBlockSize);
+    udpInput.prepare(sampleRate, NeuronSynth::subBlockSize);
+
+    // Keep the voice state resident, the callback must never wait for a page fault
+    auto const lockResult = threadTuning.lockMemory();
+    if (lockResult.failed()) { DBG(lockResult.getErrorMessage()); }
+
+    synth.prefault();
+}
+
+void MainComponent::getNextAudioBlock(const AudioSourceChannelInfo& bufferToFill)
+{
+    // The audio thread is not ours, so it can only be set up from inside the callback
+    if (!audioThreadTuned.exchange(true)) { threadTuning.applyToCurrentThread(ThreadTuning::Role::audio); }
+
+    auto const callbackStart = Time::getHighResolutionTicks();
+
+    // prepare buffer, only the region we were asked for
+    bufferToFill.clearActiveBufferRegion();
+    auto const buffer      = bufferToFill.buffer;
+    auto const numChannels = buffer->getNumChannels();
+
+    if (numChannels == 0 || bufferToFill.numSamples <= 0) { return; }
+
+    // get Slider values
+    auto& initialisation       = udpInput.initialisation;
+    bool udpMode               = udpModeButton.getToggleState();
+    float masterGain           = amplitudeSlider.getValue();
+    int numOSC                 = udpMode ? initialisation.numFrequenciesReceived : static_cast<int>(oscSlider.getValue());
+    float webDensity           = webSlider.getValue();
+    float highFrequency        = highcutSlider.getValue();
+    float subFrequency         = std::floor(frequencySlider.getValue());
+    synth.env.defaultGain      = noiseGainSlider.getValue();
+    synth.env.addGain          = attackSlider.getValue();
+    synth.env.decayFactor      = decaySlider.getValue();
+
+    synth.env.setShape(0, getEnvelopeShape(envelopeBox));
+    synth.env.setShape(1, getEnvelopeShape(inhibitoryEnvelopeBox));
+
+    // Under load the governor may take shortcuts the controls did not ask for
+    auto const compact = compactButton.getToggleState() || governor.useCompactVoices();
+    synth.setVoiceLayout(compact ? NeuronSynth::VoiceLayout::compact : NeuronSynth::VoiceLayout::full);
+    synth.setVoiceShare(governor.getVoiceShare());
+    synth.setBlockRateEnvelopes(governor.useBlockRateEnvelopes());
+
+    // A shard only has voices for its own neurons, voice 0 being neuron shardFirst
+    numOSC                = std::min(numOSC, maxNumOsc);
+    auto const shardFirst = cluster.shardFirst;
+    auto shardEnd         = std::max(shardFirst, std::min(numOSC, cluster.shardEnd));
+
+    // Frequencies; oscillators at or above the highcut stay silent
+    int numAudible = 0;
+
+    if (udpMode)
     {
-        // Generate new phases, when NumOSC-Slider was moved
-        if (numOscChanged)
+        // While an initialisation is being received, keep the previous frequencies
+        if (initialisation.mutex.try_lock())
         {
-            int rndPhaseNum = fmod(rand(), waveTableSize);
-            phaseVector.push_back(rndPhaseNum);
-        }
+            auto const numKnown = std::min(numOSC, static_cast<int>(initialisation.listOfFrequencies.size()));
 
-        // Oscillator, that fills the whole buffer at once
-        if (subFrequency < highFrequency)
-        {
-            for (int sample = 0; sample < buffer->getNumSamples(); sample++)
+            // Copied only when it changed, and without allocating
+            if (mergedVoicesVersion != initialisation.mergedVoicesVersion)
             {
-                env.tick(i);
+                mergedVoices.copyFrom(initialisation.mergedVoices);
+                mergedVoicesVersion = initialisation.mergedVoicesVersion;
+                scaleGainLimits(mergedVoices.getNumSlots() > 0);
+            }
+
+            // One voice per distinct frequency, as many of them as there are voices
+            auto const numSlots = std::min(mergedVoices.getNumSlots(), maxNumOsc);
 
-                for (int channel = 0; channel < 2; channel++)
-                { buffer->addSample(channel, sample, waveTable[phaseVector[i]] * env.getGain(i)); }
+            for (int i = 0; i < numSlots; i++) { synth.setFrequency(i, mergedVoices.getSlotFrequency(i)); }
 
-                if (udpMode) { updateFrequency(listOfFrequencies[i], i); }
-                else
-                {
-                    updateFrequency(subFrequency, i);
-                }
+            if (numSlots == 0)
+            {
+                for (int i = shardFirst; i < std::min(numKnown, shardEnd); i++)
+                { synth.setFrequency(i - shardFirst, initialisation.listOfFrequencies[i]); }
             }
+
+            numAudible = subFrequency < highFrequency ? (numSlots > 0 ? numSlots : numKnown) : 0;
+            initialisation.mutex.unlock();
+        }
+        else
+        {
+            numAudible = subFrequency < highFrequency ? lastNumAudible : 0;
         }
-        if (!udpMode)
+    }
+    else
+    {
+        for (int i = 0; i < numOSC && subFrequency < highFrequency; i++)
         {
+            if (i >= shardFirst && i < shardEnd) { synth.setFrequency(i - shardFirst, subFrequency); }
+            numAudible = i + 1;
+
             // Calculating next frequency
             if (algoButton.getToggleState())
             {
@@ -303,17 +523,153 @@ void MainComponent::getNextAudioBlock(const AudioSourceChannelInfo& bufferToFill
         }
     }
 
-    oldNumOsc = numOSC;
-    buffer->applyGain(masterGain * 0.5f);
+    lastNumAudible = numAudible;
+
+    // Neurons that share a frequency share a voice, see FrequencyIndex
+    auto const merged = udpMode && mergedVoices.getNumSlots() > 0;
+    if (merged) { shardEnd = std::min(mergedVoices.getNumSlots(), maxNumOsc); }
+
+    // Outside UDP mode, or once an initialisation has cleared the merge, every voice is one neuron again
+    if (merged != gainLimitsScaled) { scaleGainLimits(merged); }
+
+    synth.setNumVoices(shardEnd - shardFirst);
+
+    // oscillation, with spikes from UDP or one of the internal sources
+    SpikeSource* source = udpMode ? &udpInput : internalSource.load();
+    auto const left     = buffer->getWritePointer(0, bufferToFill.startSample);
+    auto const right    = numChannels > 1 ? buffer->getWritePointer(1, bufferToFill.startSample) : nullptr;
+
+    // The network's inhibitory neurons are the second envelope population
+    auto const firstInhibitory = jlimit(0, maxNumOsc, (source == &network ? network.getNumExcitatory() : maxNumOsc)
+                                                          - shardFirst);
+
+    if (firstInhibitory != firstInhibitoryVoice)
+    {
+        synth.env.assignPopulation(0, firstInhibitory, 0);
+        synth.env.assignPopulation(firstInhibitory, maxNumOsc, 1);
+        firstInhibitoryVoice = firstInhibitory;
+    }
+
+    if (cluster.isSharded())
+    {
+        shardSpikes.setSource(*source, numAudible, shardFirst, shardEnd);
+        source = &shardSpikes;
+    }
+    else if (merged)
+    {
+        mergedSpikes.setSource(*source, mergedVoices);
+        source = &mergedSpikes;
+    }
+
+    auto const numShardAudible = jlimit(0, shardEnd - shardFirst, numAudible - shardFirst);
+    auto const numTriggered    = synth.render(left, right, bufferToFill.numSamples, numShardAudible, *source);
+    auto energy                = synth.getEnvelopeEnergy();
+
+    if (shardSender.isRunning() && shardSender.getFormat() == ShardSender::Format::cells)
+    {
+        // A render node hands its shard to the mixer and stays silent itself
+        shardSender.push(left, bufferToFill.numSamples, energy);
+        bufferToFill.clearActiveBufferRegion();
+    }
+    else
+    {
+        if (shardMixer.isRunning()) { energy += shardMixer.mix(left, right, bufferToFill.numSamples); }
+
+        // Level normalisation and the true-peak limiter, in place of a plain gain
+        float* const output[] = {left, right};
+        outputStage.process(output, right != nullptr ? 2 : 1, bufferToFill.numSamples, masterGain * 0.5f, energy);
+
+        // Mixers that are not ours get the finished output
+        if (shardSender.isRunning()) { shardSender.push(left, bufferToFill.numSamples, energy); }
+    }
+
+    // Publish at about the view's frame rate, more would only be skipped
+    samplesSinceActivityFrame += bufferToFill.numSamples;
+
+    if (samplesSinceActivityFrame >= samplesPerActivityFrame)
+    {
+        samplesSinceActivityFrame = 0;
+        synth.getPeakGains(activityFrames.getWriteFrame().data(), ActivityFrames::numBins);
+        activityFrames.publish();
+    }
+
+    auto const callbackSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - callbackStart);
+    auto const load            = static_cast<float>(callbackSeconds / (bufferToFill.numSamples * secondsPerSample));
+
+    numCallbacks.fetch_add(1, std::memory_order_relaxed);
+    numSpikesRendered.fetch_add(static_cast<uint64_t>(numTriggered), std::memory_order_relaxed);
+    numActiveVoices.store(numShardAudible, std::memory_order_relaxed);
+    numStolenVoices.store(synth.getNumStolenVoices(), std::memory_order_relaxed);
+    callbackLoad.store(callbackLoad.load(std::memory_order_relaxed) * 0.9f + load * 0.1f, std::memory_order_relaxed);
+    if (load > 1.f) { numOverruns.fetch_add(1, std::memory_order_relaxed); }
+
+    governor.update(callbackSeconds, bufferToFill.numSamples);
+}
+
+void MainComponent::scaleGainLimits(bool bySlotSize)
+{
+    // A merged voice may rise as high as all of its neurons together, any other voice as high as one
+    for (int i = 0; i < maxNumOsc; i++)
+    {
+        auto const size = bySlotSize && i < mergedVoices.getNumSlots() ? mergedVoices.getSlotSize(i) : 1;
+        synth.env.setGainLimitScale(i, static_cast<float>(size));
+    }
+
+    gainLimitsScaled = bySlotSize;
 }
 
 void MainComponent::releaseResources() { }
 
 void MainComponent::paint(Graphics& g) { g.fillAll(getLookAndFeel().findColour(ResizableWindow::backgroundColourId)); }
 
+void MainComponent::timerCallback()
+{
+    auto status       = portStatus;
+    auto const tuning = threadTuning.getReport();
+    auto const stream = udpInput.getStreamStats().getSummary();
+    auto const tier   = static_cast<LoadGovernor::Tier>(governor.getReportedTier());
+
+    for (LoadGovernor::Change change; governor.popChange(change);)
+    {
+        DBG("Rendering " << LoadGovernor::getTierName(change.to) << " instead of "
+                         << LoadGovernor::getTierName(change.from) << " at a load of " << change.load);
+    }
+
+    if (stream.isNotEmpty()) { status << " | " << stream; }
+    if (tier != LoadGovernor::Tier::full)
+    {
+        status << " | under load: " << LoadGovernor::getTierName(tier) << ", "
+               << roundToInt(governor.getReportedVoiceShare() * 100.f) << "% of voices";
+    }
+    if (clusterStatus.isNotEmpty()) { status << " | " << clusterStatus; }
+    if (shardMixer.isRunning()) { status << ", " << shardMixer.getNumActiveShards() << " shards"; }
+    if (tuning.isNotEmpty()) { status << " | " << tuning; }
+    if (metricsStatus.isNotEmpty()) { status << " | " << metricsStatus; }
+
+    if (status != lastStatus)
+    {
+        DBG(status);
+        statusLabel.setText(status, dontSendNotification);
+        lastStatus = status;
+    }
+}
+
 void MainComponent::resized()
 {
-    auto const area = getLocalBounds();
+    auto area = getLocalBounds();
+
+    statusLabel.setBounds(area.removeFromBottom(24));
+
+    auto controlRow         = area.removeFromBottom(area.getHeight() / 10);
+    auto const controlWidth = controlRow.getWidth() / 8;
+    networkButton.setBounds(controlRow.removeFromLeft(controlWidth));
+    oscButton.setBounds(controlRow.removeFromLeft(controlWidth));
+    recordButton.setBounds(controlRow.removeFromLeft(controlWidth));
+    replayButton.setBounds(controlRow.removeFromLeft(controlWidth));
+    compactButton.setBounds(controlRow.removeFromLeft(controlWidth));
+    envelopeBox.setBounds(controlRow.removeFromLeft(controlWidth));
+    inhibitoryEnvelopeBox.setBounds(controlRow.removeFromLeft(controlWidth));
+    replaySpeedSlider.setBounds(controlRow);
 
     auto const heightForth = area.getHeight() / 5;
     auto const halfWidth   = area.getWidth() / 2;
@@ -327,6 +683,7 @@ void MainComponent::resized()
     noiseGainSlider.setBounds(halfWidth, 0, halfWidth, heightForth);
     attackSlider.setBounds(halfWidth, heightForth, halfWidth, heightForth);
     decaySlider.setBounds(halfWidth, heightForth * 2, halfWidth, heightForth);
+    activityView.setBounds(halfWidth, heightForth * 3, halfWidth, heightForth);
 
     portNumberEditor.setBounds(0, heightForth * 4 + heightForth / 2, halfWidth, heightForth / 2);
     algoButton.setBounds(halfWidth, heightForth * 4, halfWidth, heightForth / 2);
@@ -1,6 +1,18 @@
 
 #pragma once
 
+#include "ActivityView.h"
+#include "LoadGovernor.h"
+#include "MetricsServer.h"
+#include "NeuronSynth.h"
+#include "OscSpikeInput.h"
+#include "OutputStage.h"
+#include "RandomSpikeSource.h"
+#include "RenderCluster.h"
+#include "SpikeLog.h"
+#include "SpikingNetwork.h"
+#include "ThreadTuning.h"
+#include "UdpSpikeInput.h"
 #include "readerwriterqueue.h"
 #include <JuceHeader.h>
 #include <cstring>
@@ -11,84 +23,24 @@
     This component lives inside our window, and this is where you should put all
     your controls and content.
 */
-enum class MessageType : uint8_t
-{
-    Performance,
-    Initialisation,
-    InitialisationContent,
-    Unknown,
-};
-struct PerformanceMessage
-{
-    MessageType type;
-    uint16_t index;
-};
-static_assert(sizeof(PerformanceMessage) == 4, "");
-
-struct InitialisationMessage
-{
-    MessageType type;
-    uint16_t numFrequencies;
-    uint16_t chunkSize;
-};
-
-struct InitialisationContentMessage
-{
-    MessageType type;
-    float frequency;
-};
-
-class ExponentialDecay
-{
-public:
-    ExponentialDecay() { reset(); }
-
-    void reset() { gains.fill(defaultGain); }
-
-    void trigger(int index)
-    {
-        gains[index] += addGain;
-
-        if (gains[index] > gainLimit)
-        {
-            gains[index] = gainLimit;
-            DBG("Neuron peaked");
-        }
-    }
-
-    void tick(int index)
-    {
-        float g = gains[index];
-
-        if (g > defaultGain + 0.01f)  //
-        { g *= decayFactor; }
-        if (g < defaultGain + 0.01f && g > defaultGain)  //
-        { g = defaultGain; }
-
-        gains[index] = g;
-    }
-
-    float getGain(int index) { return gains[index]; }
-
-    float defaultGain {0.f};
-    float addGain {1.3f};
-    float decayFactor {0.99996f};
-
-private:
-    float gainLimit {12.f};
-    std::array<float, 20000> gains {};
-};
-
-class MainComponent : public AudioAppComponent
+class MainComponent
+    : public AudioAppComponent
+    , private Timer
 
 {
 public:
     //==============================================================================
-    MainComponent();
+    explicit MainComponent(String const& commandLine = {});
 
     ~MainComponent();
 
-    void updateFrequency(float f, int index);
+    void applyPorts();
+    void selectInternalSource(SpikeSource* source);
+    void toggleNetwork(bool shouldRun);
+    void toggleOsc(bool shouldListen);
+    void toggleRecording(bool shouldRecord);
+    void toggleReplay(bool shouldReplay);
+    void registerMetrics();
     //==============================================================================
     void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
     void getNextAudioBlock(const AudioSourceChannelInfo& bufferToFill) override;
@@ -97,27 +49,60 @@ public:
     //==============================================================================
     void paint(Graphics& g) override;
     void resized() override;
+    void timerCallback() override;
 
 private:
-    static int const waveTableSize = 1024;
-    static int const maxNumOsc     = 20000;
-    float waveTable[waveTableSize];
-
-    std::vector<int> phaseVector;
-    std::vector<float> gainVector;
-    juce::AudioBuffer<float> fillBuffer;
-
-    float phase {};
-    float increment {};
-    float frequency {};
-    double currentSampleRate;
-
-    int oldNumOsc {};
-
-    ExponentialDecay env {};
+    static int const maxNumOsc = NeuronSynth::maxNumVoices;
+
+    void scaleGainLimits(bool bySlotSize);
+
+    NeuronSynth synth {};
+    OutputStage outputStage {};
+    LoadGovernor governor {};
+    int lastNumAudible {};
+    int firstInhibitoryVoice {-1};
+
+    ActivityFrames activityFrames {};
+    int samplesPerActivityFrame {};
+    int samplesSinceActivityFrame {};
+
+    ThreadTuning threadTuning {};
+    std::atomic<bool> audioThreadTuned {false};
+
+    RandomSpikeSource randomSpikes {maxNumOsc};
+    SpikingNetwork network {threadTuning};
+    SpikeReplay replay {};
+    OscSpikeInput oscInput {threadTuning};
+    std::atomic<SpikeSource*> internalSource {&randomSpikes};
+    SpikeRecorder recorder {threadTuning};
+    UdpSpikeInput udpInput {recorder, threadTuning};
+
+    // The audio thread's copy of udpInput.initialisation.mergedVoices
+    FrequencyIndex mergedVoices {};
+    uint32_t mergedVoicesVersion {};
+    bool gainLimitsScaled {};
+    MergedSpikeSource mergedSpikes {};
+
+    ClusterSettings cluster {};
+    ShardSpikeSource shardSpikes {};
+    ShardSender shardSender {threadTuning};
+    ShardMixer shardMixer {threadTuning};
+    HeadlessDriver headlessDriver {};
+    juce::String clusterStatus;
+
+    // Written by the audio thread, read by the metrics server
+    std::atomic<uint64_t> numCallbacks {0};
+    std::atomic<uint64_t> numOverruns {0};
+    std::atomic<uint64_t> numSpikesRendered {0};
+    std::atomic<float> callbackLoad {0.f};
+    std::atomic<int> numActiveVoices {0};
+    std::atomic<int> numStolenVoices {0};
+    double secondsPerSample {};
+
+    MetricsServer metrics {};
+    juce::String metricsStatus;
 
     std::array<float, 10000> envelopeValues {};
-    std::vector<float> listOfFrequencies {20000};
 
     juce::Slider frequencySlider;
     juce::Label frequencyLabel;
@@ -130,24 +115,23 @@ private:
     juce::Slider noiseGainSlider;
     juce::TextButton algoButton;
     juce::TextButton udpModeButton;
+    juce::TextButton networkButton;
+    juce::TextButton oscButton;
+    juce::TextButton recordButton;
+    juce::TextButton replayButton;
+    juce::TextButton compactButton;
+    juce::ComboBox envelopeBox;
+    juce::ComboBox inhibitoryEnvelopeBox;
+    juce::Slider replaySpeedSlider;
+    std::unique_ptr<juce::FileChooser> replayChooser;
     juce::TextEditor portNumberEditor;
+    juce::Label statusLabel;
+    ActivityView activityView {activityFrames};
+    juce::String portStatus;
+    juce::String lastStatus;
 
     bool oldToggleState = false;
 
-    moodycamel::ReaderWriterQueue<int> queue {200};
-    const int maxIndexToReadUdpMessage = 1;
-
-    std::thread udpThread;
-    juce::DatagramSocket udp {};
-    constexpr static int portNumber = 5001;
-    std::atomic<bool> doneFlag {false};
-
-    std::atomic<bool> systemIsInInitMode {};
-    uint16_t numFrequenciesReceived;
-    uint16_t chunkSize;
-
-    std::array<int, 10000> spikingFrequencies {};
-
     void readSmallInitialisation() { }
 
     void readBigInitialisation() { }
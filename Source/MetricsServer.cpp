@@ -0,0 +1,133 @@
+#include "MetricsServer.h"
+
+MetricsServer::~MetricsServer() { stop(); }
+
+void MetricsServer::addCounter(juce::String const& name, juce::String const& help, Reader read)
+{
+    jassert(!isRunning());
+    metrics.push_back({name, help, "counter", std::move(read), {}});
+}
+
+void MetricsServer::addGauge(juce::String const& name, juce::String const& help, Reader read)
+{
+    jassert(!isRunning());
+    metrics.push_back({name, help, "gauge", std::move(read), {}});
+}
+
+void MetricsServer::addHistogram(juce::String const& name, juce::String const& help, HistogramReader read)
+{
+    jassert(!isRunning());
+    metrics.push_back({name, help, "histogram", {}, std::move(read)});
+}
+
+juce::Result MetricsServer::start(int portToListenOn)
+{
+    stop();
+
+    port     = portToListenOn;
+    listener = std::make_unique<juce::StreamingSocket>();
+
+    // Only reachable from this machine, scrapers run next to the engine or tunnel in
+    if (!listener->createListener(port, "127.0.0.1"))
+    {
+        listener.reset();
+        return juce::Result::fail("Could not listen for metrics scrapes on port " + juce::String(port));
+    }
+
+    stopRequested.store(false);
+    serverThread = std::thread([this] { run(); });
+    return juce::Result::ok();
+}
+
+void MetricsServer::stop()
+{
+    if (serverThread.joinable())
+    {
+        stopRequested.store(true);
+        serverThread.join();
+    }
+
+    listener.reset();
+}
+
+int MetricsServer::parsePort(juce::String const& commandLine)
+{
+    for (auto const& argument : juce::StringArray::fromTokens(commandLine, " ", "\""))
+    {
+        if (argument.startsWith("--metrics-port="))
+        { return juce::jlimit(0, 65535, argument.fromFirstOccurrenceOf("=", false, false).getIntValue()); }
+    }
+
+    return defaultPort;
+}
+
+void MetricsServer::run()
+{
+    DBG("Metrics served on http://127.0.0.1:" << port << "/metrics");
+
+    while (!stopRequested.load())
+    {
+        // Wake up regularly to notice stop()
+        if (listener->waitUntilReady(true, 100) != 1) { continue; }
+
+        std::unique_ptr<juce::StreamingSocket> connection(listener->waitForNextConnection());
+        if (connection != nullptr) { answer(*connection); }
+    }
+}
+
+void MetricsServer::answer(juce::StreamingSocket& connection) const
+{
+    // Whatever was asked for, there is only one page. The request is read so
+    // the client does not see a reset, but it is never looked at.
+    char request[2048];
+    if (connection.waitUntilReady(true, 1000) == 1) { connection.read(request, sizeof(request), false); }
+
+    auto const body = renderText().toStdString();
+    auto const head = "HTTP/1.0 200 OK\r\n"
+                      "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                      "Content-Length: "
+                      + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+
+    connection.write(head.data(), static_cast<int>(head.size()));
+    connection.write(body.data(), static_cast<int>(body.size()));
+}
+
+juce::String MetricsServer::renderText() const
+{
+    juce::String text;
+    juce::String family;
+
+    for (auto const& metric : metrics)
+    {
+        auto const metricFamily = metric.name.upToFirstOccurrenceOf("{", false, false);
+
+        if (metricFamily != family)
+        {
+            family = metricFamily;
+            text << "# HELP " << family << " " << metric.help << "\n";
+            text << "# TYPE " << family << " " << metric.type << "\n";
+        }
+
+        if (metric.readHistogram) { renderHistogram(text, metric.name, metric.readHistogram()); }
+        else { text << metric.name << " " << juce::String(metric.read(), 6) << "\n"; }
+    }
+
+    return text;
+}
+
+void MetricsServer::renderHistogram(juce::String& text, juce::String const& name, Histogram const& histogram)
+{
+    jassert(histogram.counts.size() == histogram.upperBounds.size() + 1);
+
+    double cumulative = 0.0;
+
+    for (size_t i = 0; i < histogram.counts.size(); i++)
+    {
+        auto const bound = i < histogram.upperBounds.size() ? juce::String(histogram.upperBounds[i], 6) : "+Inf";
+        cumulative += histogram.counts[i];
+        text << name << "_bucket{le=\"" << bound << "\"} " << juce::String(cumulative, 0) << "\n";
+    }
+
+    text << name << "_sum " << juce::String(histogram.sum, 6) << "\n";
+    text << name << "_count " << juce::String(cumulative, 0) << "\n";
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+/*
+    Serves the engine's counters in the Prometheus text format over plain HTTP
+    on localhost, so running instances can be scraped and graphed.
+
+    The metrics themselves stay where they are counted: the receive threads and
+    the audio thread bump their own relaxed atomics and never know about this
+    class. Every registered metric is just a function that reads one of those
+    atomics, called on the server thread while a scrape is answered.
+
+    A name may carry labels, e.g. oscweb_udp_messages_total{type="unknown"};
+    consecutive registrations of the same family share one HELP/TYPE header.
+    A histogram reader returns plain per bucket counts, the cumulative _bucket,
+    _sum and _count series are derived from them when the page is rendered.
+*/
+class MetricsServer
+{
+public:
+    static constexpr int defaultPort = 9464;
+
+    using Reader = std::function<double()>;
+
+    struct Histogram
+    {
+        std::vector<double> upperBounds;  // the last bucket is always +Inf and has no bound here
+        std::vector<double> counts;       // one more than upperBounds
+        double sum {};
+    };
+
+    using HistogramReader = std::function<Histogram()>;
+
+    MetricsServer() = default;
+    ~MetricsServer();
+
+    // Register everything before start(), the list is not locked
+    void addCounter(juce::String const& name, juce::String const& help, Reader read);
+    void addGauge(juce::String const& name, juce::String const& help, Reader read);
+    void addHistogram(juce::String const& name, juce::String const& help, HistogramReader read);
+
+    juce::Result start(int port = defaultPort);
+    void stop();
+    bool isRunning() const { return serverThread.joinable(); }
+    int getPort() const { return port; }
+
+    // The exposition text as it would be served right now
+    juce::String renderText() const;
+
+    // Reads --metrics-port=N from the command line, 0 turns the server off
+    static int parsePort(juce::String const& commandLine);
+
+private:
+    struct Metric
+    {
+        juce::String name;
+        juce::String help;
+        char const* type;
+        Reader read;
+        HistogramReader readHistogram;
+    };
+
+    static void renderHistogram(juce::String& text, juce::String const& name, Histogram const& histogram);
+
+    void run();
+    void answer(juce::StreamingSocket& connection) const;
+
+    std::vector<Metric> metrics;
+
+    int port {};
+    std::unique_ptr<juce::StreamingSocket> listener;
+    std::thread serverThread;
+    std::atomic<bool> stopRequested {false};
+
+    JUCE_DECLARE_NON_COPYABLE(MetricsServer)
+};
@@ -0,0 +1,654 @@
+#include "NeuronSynth.h"
+
+#include "ThreadTuning.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+NeuronSynth::NeuronSynth()
+    : phases(maxNumVoices, 0.f)
+    , increments(maxNumVoices, 0.f)
+    , compactVoices(maxNumVoices, CompactVoice {})
+{
+    for (int i = 0; i < waveTableSize; i++) { waveTable[i] = std::sin(2.f * double_Pi * i / waveTableSize); }
+
+    for (int i = 0; i < gainStepsPerOctave; i++)
+    { gainFractions[i] = static_cast<float>(std::exp2(static_cast<double>(i) / gainStepsPerOctave)); }
+
+    for (int i = 0; i < 16; i++) { gainOctaves[i] = static_cast<float>(std::exp2(i - gainOctaveOffset)); }
+
+    chooseTileSizes();
+}
+
+void NeuronSynth::chooseTileSizes()
+{
+    // Renders a busy half-size bank with every candidate and keeps the fastest
+    static constexpr int voiceTileCandidates[]  = {256, 1024, 4096, maxNumVoices};
+    static constexpr int sampleTileCandidates[] = {16, 32, subBlockSize};
+    static constexpr int numTestVoices          = maxNumVoices / 2;
+
+    using Clock    = std::chrono::steady_clock;
+    auto best      = Clock::duration::max();
+    int bestVoice  = voiceTileSize;
+    int bestSample = sampleTileSize;
+
+    for (int i = 0; i < numTestVoices; i++)
+    {
+        increments[i] = 1.f + 0.01f * static_cast<float>(i);
+        env.trigger(i);
+    }
+
+    for (auto voiceTile : voiceTileCandidates)
+    {
+        for (auto sampleTile : sampleTileCandidates)
+        {
+            voiceTileSize  = voiceTile;
+            sampleTileSize = sampleTile;
+
+            auto fastest = Clock::duration::max();
+
+            for (int run = 0; run < 3; run++)
+            {
+                auto const start = Clock::now();
+                renderSubBlock(subBlockSize, numTestVoices);
+                fastest = std::min(fastest, Clock::now() - start);
+            }
+
+            if (fastest < best)
+            {
+                best       = fastest;
+                bestVoice  = voiceTile;
+                bestSample = sampleTile;
+            }
+        }
+    }
+
+    voiceTileSize  = bestVoice;
+    sampleTileSize = bestSample;
+
+    std::fill(phases.begin(), phases.end(), 0.f);
+    std::fill(increments.begin(), increments.end(), 0.f);
+    env.reset();
+
+    DBG("Rendering in tiles of " << voiceTileSize << " voices x " << sampleTileSize << " samples");
+}
+
+void NeuronSynth::prepare(double newSampleRate)
+{
+    sampleRate     = newSampleRate;
+    fadeOutSamples = std::max(1, static_cast<int>(fadeOutSeconds * sampleRate));
+    env.prepare(sampleRate);
+}
+
+void NeuronSynth::prefault() const
+{
+    ThreadTuning::prefault(this, sizeof(*this));
+    ThreadTuning::prefault(phases.data(), phases.size() * sizeof(float));
+    ThreadTuning::prefault(increments.data(), increments.size() * sizeof(float));
+    ThreadTuning::prefault(compactVoices.data(), compactVoices.size() * sizeof(CompactVoice));
+}
+
+void NeuronSynth::getPeakGains(float* dest, int numBins) const
+{
+    std::fill(dest, dest + numBins, 0.f);
+
+    for (int i = 0; i < numVoices; i++)
+    {
+        auto const bin = static_cast<int>(static_cast<int64_t>(i) * numBins / numVoices);
+        auto gain      = env.defaultGain;
+
+        if (layout == VoiceLayout::full) { gain = env.getGain(i); }
+        else if ((compactVoices[i].gain & excitedFlag) != 0) { gain = decodeGain(compactVoices[i].gain); }
+
+        dest[bin] = std::max(dest[bin], gain);
+    }
+}
+
+void NeuronSynth::setVoiceLayout(VoiceLayout newLayout)
+{
+    if (newLayout == layout) { return; }
+
+    auto const gains        = env.getGains();
+    auto const pending      = env.getPendingGains();
+    auto const holds        = env.getHolds();
+    auto const threshold    = env.defaultGain + 0.01f;
+    auto const phaseToFixed = static_cast<double>(1u << phaseShift);
+
+    for (int i = 0; i < maxNumVoices; i++)
+    {
+        auto& voice = compactVoices[i];
+
+        if (newLayout == VoiceLayout::compact)
+        {
+            voice.phase     = static_cast<uint32_t>(phases[i] * phaseToFixed);
+            voice.increment = encodeIncrement(increments[i] * phaseToFixed);
+            voice.gain      = gains[i] + pending[i] > threshold ? encodeGain(gains[i] + pending[i]) : 0;
+        }
+        else
+        {
+            phases[i]     = static_cast<float>(voice.phase / phaseToFixed);
+            increments[i] = static_cast<float>(decodeIncrement(voice.increment) / phaseToFixed);
+            gains[i]      = (voice.gain & excitedFlag) != 0 ? decodeGain(voice.gain) : env.defaultGain;
+            pending[i]    = 0.f;
+            holds[i]      = 0.f;
+        }
+    }
+
+    layout = newLayout;
+}
+
+int NeuronSynth::getGainBin(float gain)
+{
+    // The exponent and the top bit of the mantissa are log2 of the gain in half octaves
+    uint32_t bits = 0;
+    std::memcpy(&bits, &gain, sizeof(bits));
+    return juce::jlimit(0, numGainBins - 1, static_cast<int>(bits >> 22) - firstGainBits);
+}
+
+float NeuronSynth::getGainBinFloor(int bin)
+{
+    auto const bits = static_cast<uint32_t>(bin + firstGainBits) << 22;
+    float gain      = 0.f;
+    std::memcpy(&gain, &bits, sizeof(gain));
+    return gain;
+}
+
+float NeuronSynth::getLoudness(int voice) const
+{
+    if (layout == VoiceLayout::compact)
+    {
+        auto const code = compactVoices[voice].gain;
+        return (code & excitedFlag) != 0 ? decodeGain(code) : env.defaultGain;
+    }
+
+    // A voice that was just triggered is as loud as it is about to be
+    return env.getGain(voice) + env.getPendingGain(voice);
+}
+
+void NeuronSynth::chooseStealLevel(int numAudibleVoices)
+{
+    stealLevel      = 0.f;
+    numStolenVoices = 0;
+
+    if (voiceShare >= 1.f || numAudibleVoices == 0) { return; }
+
+    // Keep whole half octaves, loudest first, while they fit into the share.
+    // The loudest half octave is always kept, even if it alone is too many.
+    gainHistogram.fill(0);
+    for (int i = 0; i < numAudibleVoices; i++) { gainHistogram[static_cast<size_t>(getGainBin(getLoudness(i)))]++; }
+
+    auto const budget = static_cast<int>(voiceShare * static_cast<float>(numAudibleVoices));
+    int numKept       = 0;
+    int bin           = numGainBins - 1;
+
+    for (; bin >= 0 && numKept + gainHistogram[static_cast<size_t>(bin)] <= budget; bin--)
+    { numKept += gainHistogram[static_cast<size_t>(bin)]; }
+
+    if (numKept == 0 && bin >= 0) { numKept = gainHistogram[static_cast<size_t>(bin--)]; }
+    if (bin < 0) { return; }
+
+    stealLevel      = getGainBinFloor(bin + 1);
+    numStolenVoices = numAudibleVoices - numKept;
+}
+
+uint16_t NeuronSynth::encodeIncrement(double increment)
+{
+    // Below the smallest mantissa at exponent 0 a voice stands still
+    if (!(increment >= 65536.0)) { return 0; }
+
+    int exponent = 0;
+    std::frexp(std::min(increment, 4294967295.0), &exponent);
+
+    // exponent - 1 is the highest set bit, keep the 12 bits below it
+    auto shift    = exponent - 1 - 12;
+    auto mantissa = static_cast<uint32_t>(std::lround(increment / std::exp2(shift)));
+
+    if (mantissa >= 0x2000)
+    {
+        mantissa >>= 1;
+        shift++;
+    }
+
+    if (shift - 4 > 15) { return 0xffff; }
+
+    return static_cast<uint16_t>(((shift - 4) << 12) | (mantissa & 0xfffu));
+}
+
+uint16_t NeuronSynth::encodeGain(float gain) const
+{
+    auto const steps = static_cast<int>(std::lround((std::log2(gain) + gainOctaveOffset) * gainStepsPerOctave));
+    return static_cast<uint16_t>(juce::jlimit(1, excitedFlag - 1, steps) | excitedFlag);
+}
+
+void NeuronSynth::triggerCompact(int index, float weight)
+{
+    auto& voice = compactVoices[index];
+    auto gain   = (voice.gain & excitedFlag) != 0 ? decodeGain(voice.gain) : env.defaultGain;
+
+    gain       = std::min(gain + weight * env.addGain, env.getGainLimit(index));
+    voice.gain = gain > env.defaultGain + 0.01f ? encodeGain(gain) : 0;
+}
+
+void NeuronSynth::advanceCompactGains(int numSamples, int numAudibleVoices)
+{
+    // All voices decay by the same number of steps; the fraction of a step that
+    // is left over is carried to the next sub-block so the decay rate stays exact
+    gainStepRemainder += -std::log2(static_cast<double>(env.decayFactor)) * gainStepsPerOctave * numSamples;
+
+    auto const steps     = static_cast<int>(gainStepRemainder);
+    auto const threshold = encodeGain(env.defaultGain + 0.01f) & ~excitedFlag;
+    gainStepRemainder -= steps;
+
+    if (steps == 0) { return; }
+
+    for (int i = 0; i < numAudibleVoices; i++)
+    {
+        auto& voice = compactVoices[i];
+        if ((voice.gain & excitedFlag) == 0) { continue; }
+
+        auto const remaining = (voice.gain & ~excitedFlag) - steps;
+        voice.gain           = remaining > threshold ? static_cast<uint16_t>(remaining | excitedFlag) : 0;
+    }
+}
+
+void NeuronSynth::setNumVoices(int newNumVoices)
+{
+    newNumVoices = juce::jlimit(0, maxNumVoices, newNumVoices);
+    if (newNumVoices == numVoices) { return; }
+
+    if (newNumVoices > numVoices)
+    {
+        // Only the new tail starts over, silent so the envelope fades it in.
+        // Compact voices have no room for that and start at the resting gain.
+        for (int i = numVoices; i < newNumVoices; i++)
+        {
+            auto const phase = phaseRandom.nextInt(waveTableSize);
+
+            phases[i]              = static_cast<float>(phase);
+            compactVoices[i].phase = static_cast<uint32_t>(phase) << phaseShift;
+            compactVoices[i].gain  = 0;
+        }
+
+        env.silence(numVoices, newNumVoices);
+
+        // Voices that come back before they finished fading out have just been restarted
+        retireBegin = std::max(retireBegin, newNumVoices);
+    }
+    else
+    {
+        // Only voices that were heard need to fade out. Dropping more voices
+        // while a fade is running adds them to it at its current level.
+        auto const heardEnd = std::min(numVoices, lastNumAudible);
+
+        if (retireRemaining == 0)
+        {
+            retireEnd       = heardEnd;
+            retireRemaining = fadeOutSamples;
+        }
+        else
+        {
+            retireEnd = std::max(retireEnd, heardEnd);
+        }
+
+        retireBegin = newNumVoices;
+    }
+
+    if (retireBegin >= retireEnd) { retireRemaining = 0; }
+
+    numVoices = newNumVoices;
+}
+
+int NeuronSynth::render(float* left, float* right, int numSamples, int numAudibleVoices, SpikeSource& source)
+{
+    numAudibleVoices = std::min(numAudibleVoices, numVoices);
+    lastNumAudible   = numAudibleVoices;
+    renderedEnergy   = 0.0;
+    int numTriggered = 0;
+
+    env.update();
+    chooseStealLevel(numAudibleVoices);
+
+    for (int offset = 0; offset < numSamples; offset += subBlockSize)
+    {
+        auto const numSubBlockSamples = std::min(subBlockSize, numSamples - offset);
+
+        auto const numSpikes = source.pullWeightedSpikes(numSubBlockSamples, numVoices, spikingFrequencies.data(),
+                                                         spikeWeights.data(), static_cast<int>(spikingFrequencies.size()));
+
+        numTriggered += numSpikes;
+
+        if (layout == VoiceLayout::compact)
+        {
+            for (int i = 0; i < numSpikes; i++) { triggerCompact(spikingFrequencies[i], spikeWeights[i]); }
+        }
+        else
+        {
+            env.trigger(spikingFrequencies.data(), spikeWeights.data(), numSpikes);
+        }
+
+        renderSubBlock(numSubBlockSamples, numAudibleVoices);
+        if (retireRemaining > 0) { renderRetiringVoices(numSubBlockSamples); }
+
+        if (layout == VoiceLayout::compact) { advanceCompactGains(numSubBlockSamples, numAudibleVoices); }
+
+        FloatVectorOperations::add(left + offset, subBlock, numSubBlockSamples);
+        if (right != nullptr) { FloatVectorOperations::add(right + offset, subBlock, numSubBlockSamples); }
+    }
+
+    envelopeEnergy = numSamples > 0 ? static_cast<float>(renderedEnergy / numSamples) : 0.f;
+    return numTriggered;
+}
+
+void NeuronSynth::renderSubBlock(int numSamples, int numAudibleVoices)
+{
+    std::fill(subBlock, subBlock + subBlockSize, 0.f);
+
+    if (layout == VoiceLayout::compact)
+    {
+        // Compact gains are only stored per sub-block, a tile starting later
+        // in the sub-block picks up the decay that happened before it
+        decayPowers[0] = 1.f;
+        for (int i = 1; i <= numSamples; i++) { decayPowers[i] = decayPowers[i - 1] * env.decayFactor; }
+    }
+
+    renderVoices(subBlock, numSamples, 0, numAudibleVoices);
+}
+
+void NeuronSynth::renderVoices(float* dest, int numSamples, int firstVoice, int endVoice)
+{
+    for (int firstInTile = firstVoice; firstInTile < endVoice; firstInTile += voiceTileSize)
+    {
+        auto const endInTile = std::min(firstInTile + voiceTileSize, endVoice);
+
+        for (int offset = 0; offset < numSamples; offset += sampleTileSize)
+        {
+            auto const numTileSamples = std::min(sampleTileSize, numSamples - offset);
+
+            if (layout == VoiceLayout::compact)
+            { renderCompactTile(dest, offset, numTileSamples, firstInTile, endInTile); }
+            else
+            { renderTile(dest + offset, numTileSamples, firstInTile, endInTile); }
+        }
+    }
+}
+
+void NeuronSynth::renderRetiringVoices(int numSamples)
+{
+    std::fill(retireBlock, retireBlock + subBlockSize, 0.f);
+    renderVoices(retireBlock, numSamples, retireBegin, retireEnd);
+
+    // A linear fade over what is left, the retired voices' own gains are not touched
+    auto const step = 1.f / static_cast<float>(fadeOutSamples);
+    auto level      = static_cast<float>(retireRemaining) * step;
+
+    for (int i = 0; i < numSamples; i++)
+    {
+        subBlock[i] += retireBlock[i] * level;
+        level = std::max(0.f, level - step);
+    }
+
+    retireRemaining = std::max(0, retireRemaining - numSamples);
+}
+
+void NeuronSynth::renderTile(float* dest, int numSamples, int firstVoice, int endVoice)
+{
+    auto const tableSize = static_cast<float>(waveTableSize);
+    auto const gains     = env.getGains();
+    auto const pending   = env.getPendingGains();
+    auto const holds     = env.getHolds();
+    auto const tileDecay = std::pow(env.decayFactor, static_cast<float>(numSamples));
+
+    // The tile's samples, summed here so dest is only touched once per tile
+    float acc[subBlockSize] = {};
+    float energy            = 0.f;
+    int voice               = firstVoice;
+
+    // A few voices at a time keep their state in registers and give the
+    // otherwise serial phase and gain updates independent work to overlap
+    for (; voice + numInterleavedVoices <= endVoice; voice += numInterleavedVoices)
+    {
+        float phase[numInterleavedVoices], increment[numInterleavedVoices], gain[numInterleavedVoices];
+        bool settled = true;
+        bool quiet   = true;
+
+        for (int k = 0; k < numInterleavedVoices; k++)
+        {
+            phase[k]     = phases[voice + k];
+            increment[k] = increments[voice + k];
+            gain[k]      = gains[voice + k];
+            settled      = settled && env.isSettled(voice + k);
+            quiet        = quiet && gain[k] < stealLevel;
+        }
+
+        if (settled && quiet)
+        {
+            // Stolen, the voices move on as if they had been rendered
+            for (int k = 0; k < numInterleavedVoices; k++)
+            {
+                phase[k] = wrapPhase(phase[k] + increment[k] * static_cast<float>(numSamples));
+                gain[k]  = env.advance(gain[k], numSamples, tileDecay);
+            }
+        }
+        else if (settled && blockRateEnvelopes)
+        {
+            for (int sample = 0; sample < numSamples; sample++)
+            {
+                float sum = 0.f;
+
+                for (int k = 0; k < numInterleavedVoices; k++)
+                {
+                    sum += waveTable[static_cast<int>(phase[k])] * gain[k];
+
+                    phase[k] += increment[k];
+                    phase[k] = phase[k] >= tableSize ? phase[k] - tableSize : phase[k];
+                }
+
+                acc[sample] += sum;
+            }
+
+            for (int k = 0; k < numInterleavedVoices; k++) { gain[k] = env.advance(gain[k], numSamples, tileDecay); }
+        }
+        else if (settled)
+        {
+            for (int sample = 0; sample < numSamples; sample++)
+            {
+                float sum = 0.f;
+
+                for (int k = 0; k < numInterleavedVoices; k++)
+                {
+                    gain[k] = env.next(gain[k]);
+                    sum += waveTable[static_cast<int>(phase[k])] * gain[k];
+
+                    phase[k] += increment[k];
+                    phase[k] = phase[k] >= tableSize ? phase[k] - tableSize : phase[k];
+                }
+
+                acc[sample] += sum;
+            }
+        }
+        else
+        {
+            // Some voice is still attacking or held, run the full envelope for all four
+            float pendingGain[numInterleavedVoices], hold[numInterleavedVoices];
+            EnvelopeBank::Coefficients shape[numInterleavedVoices];
+
+            for (int k = 0; k < numInterleavedVoices; k++)
+            {
+                pendingGain[k] = pending[voice + k];
+                hold[k]        = holds[voice + k];
+                shape[k]       = env.getCoefficients(voice + k);
+            }
+
+            for (int sample = 0; sample < numSamples; sample++)
+            {
+                float sum = 0.f;
+
+                for (int k = 0; k < numInterleavedVoices; k++)
+                {
+                    env.next(gain[k], pendingGain[k], hold[k], shape[k]);
+                    sum += waveTable[static_cast<int>(phase[k])] * gain[k];
+
+                    phase[k] += increment[k];
+                    phase[k] = phase[k] >= tableSize ? phase[k] - tableSize : phase[k];
+                }
+
+                acc[sample] += sum;
+            }
+
+            for (int k = 0; k < numInterleavedVoices; k++)
+            {
+                pending[voice + k] = pendingGain[k];
+                holds[voice + k]   = hold[k];
+            }
+        }
+
+        for (int k = 0; k < numInterleavedVoices; k++)
+        {
+            phases[voice + k] = phase[k];
+            gains[voice + k]  = gain[k];
+            energy += gain[k] * gain[k];
+        }
+    }
+
+    for (; voice < endVoice; voice++)
+    {
+        auto phase           = phases[voice];
+        auto const increment = increments[voice];
+        auto gain            = gains[voice];
+        auto pendingGain     = pending[voice];
+        auto hold            = holds[voice];
+        auto const& shape    = env.getCoefficients(voice);
+
+        if (gain < stealLevel && env.isSettled(voice))
+        {
+            phase = wrapPhase(phase + increment * static_cast<float>(numSamples));
+            gain  = env.advance(gain, numSamples, tileDecay);
+        }
+        else
+        {
+            for (int sample = 0; sample < numSamples; sample++)
+            {
+                env.next(gain, pendingGain, hold, shape);
+                acc[sample] += waveTable[static_cast<int>(phase)] * gain;
+
+                phase += increment;
+                phase = phase >= tableSize ? phase - tableSize : phase;
+            }
+        }
+
+        phases[voice]  = phase;
+        gains[voice]   = gain;
+        pending[voice] = pendingGain;
+        holds[voice]   = hold;
+        energy += gain * gain;
+    }
+
+    for (int sample = 0; sample < numSamples; sample++) { dest[sample] += acc[sample]; }
+    renderedEnergy += static_cast<double>(energy) * numSamples;
+}
+
+void NeuronSynth::renderCompactTile(float* dest, int offset, int numSamples, int firstVoice, int endVoice)
+{
+    auto const decay       = env.decayFactor;
+    auto const restingGain = env.defaultGain;
+    auto const decayBefore = decayPowers[offset];
+
+    float acc[subBlockSize] = {};
+    float energy            = 0.f;
+    int voice               = firstVoice;
+
+    for (; voice + numInterleavedVoices <= endVoice; voice += numInterleavedVoices)
+    {
+        uint32_t phase[numInterleavedVoices], increment[numInterleavedVoices];
+        float gain[numInterleavedVoices], factor[numInterleavedVoices];
+        bool quiet = true;
+
+        for (int k = 0; k < numInterleavedVoices; k++)
+        {
+            auto const& v      = compactVoices[voice + k];
+            auto const excited = (v.gain & excitedFlag) != 0;
+
+            phase[k]     = v.phase;
+            increment[k] = decodeIncrement(v.increment);
+            gain[k]      = excited ? decodeGain(v.gain) * decayBefore : restingGain;
+            factor[k]    = excited ? decay : 1.f;
+            quiet        = quiet && gain[k] < stealLevel;
+        }
+
+        if (quiet)
+        {
+            // Stolen; the gains are advanced for all voices by advanceCompactGains()
+            for (int k = 0; k < numInterleavedVoices; k++)
+            { phase[k] += increment[k] * static_cast<uint32_t>(numSamples); }
+        }
+        else if (blockRateEnvelopes)
+        {
+            for (int sample = 0; sample < numSamples; sample++)
+            {
+                float sum = 0.f;
+
+                for (int k = 0; k < numInterleavedVoices; k++)
+                {
+                    sum += waveTable[phase[k] >> phaseShift] * gain[k];
+                    phase[k] += increment[k];
+                }
+
+                acc[sample] += sum;
+            }
+        }
+        else
+        {
+            for (int sample = 0; sample < numSamples; sample++)
+            {
+                float sum = 0.f;
+
+                for (int k = 0; k < numInterleavedVoices; k++)
+                {
+                    gain[k] *= factor[k];
+                    sum += waveTable[phase[k] >> phaseShift] * gain[k];
+                    phase[k] += increment[k];
+                }
+
+                acc[sample] += sum;
+            }
+        }
+
+        for (int k = 0; k < numInterleavedVoices; k++)
+        {
+            compactVoices[voice + k].phase = phase[k];
+            energy += gain[k] * gain[k];
+        }
+    }
+
+    for (; voice < endVoice; voice++)
+    {
+        auto& v            = compactVoices[voice];
+        auto const excited = (v.gain & excitedFlag) != 0;
+        auto phase         = v.phase;
+        auto const step    = decodeIncrement(v.increment);
+        auto gain          = excited ? decodeGain(v.gain) * decayBefore : restingGain;
+        auto const factor  = excited ? decay : 1.f;
+
+        if (gain < stealLevel)
+        {
+            phase += step * static_cast<uint32_t>(numSamples);
+        }
+        else
+        {
+            for (int sample = 0; sample < numSamples; sample++)
+            {
+                gain *= factor;
+                acc[sample] += waveTable[phase >> phaseShift] * gain;
+                phase += step;
+            }
+        }
+
+        v.phase = phase;
+        energy += gain * gain;
+    }
+
+    for (int sample = 0; sample < numSamples; sample++) { dest[offset + sample] += acc[sample]; }
+    renderedEnergy += static_cast<double>(energy) * numSamples;
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "EnvelopeBank.h"
+#include "FastRandom.h"
+#include "SpikeSource.h"
+#include <JuceHeader.h>
+
+#include <array>
+#include <cmath>
+#include <vector>
+
+//==============================================================================
+/*
+    The oscillator bank: one wavetable oscillator per neuron, its amplitude
+    driven by the neuron's envelope from the EnvelopeBank.
+
+    Whatever block size the device asks for, rendering happens in internal
+    sub-blocks of at most subBlockSize samples. Spikes are pulled and triggered
+    per sub-block, and every sub-block is summed into a small aligned scratch
+    buffer that stays in L1 before it is added to the output once.
+
+    Inside a sub-block the voices are rendered in tiles: a tile of voices is
+    run over a tile of samples while its phases and gains stay in L1. Within a
+    tile a few voices are advanced side by side in registers, and the tile's
+    samples are summed locally before they touch the scratch buffer once. The
+    best tile sizes depend on the cache sizes of the machine, so they are
+    measured once when the synth is created.
+
+    Changing the number of voices only touches the voices that come or go.
+    New voices start at a random phase and fade in through their envelope;
+    voices that are dropped keep sounding for fadeOutSeconds while their sum
+    is faded out, and stop being rendered after that.
+
+    With the compact voice layout every voice is one 8 byte CompactVoice
+    instead of 12 bytes spread over three arrays, so half again as many voices
+    fit into the same cache. Phases are 32 bit fixed point, gains are stored
+    in the log domain and only advanced once per sub-block, and increments are
+    a 16 bit mini float. Everything is expanded to float in registers while a
+    tile is rendered, which keeps the audible result within a fraction of a
+    cent and of a decibel of the full layout. The compact layout has no room
+    for envelope stages, its voices always use the exponential shape.
+
+    When the CPU cannot keep up, the LoadGovernor trades detail for time. With
+    a voice share below 1 only about that share of the audible voices, the
+    loudest, is rendered: the rest are stolen, their phases and envelopes move
+    on without being heard. Voices that are attacking or held are never
+    stolen. With block rate envelopes a settled voice holds its gain over a
+    tile and steps it once at the end, instead of every sample.
+*/
+class NeuronSynth
+{
+public:
+    static constexpr int maxNumVoices         = EnvelopeBank::maxNumVoices;
+    static constexpr int waveTableBits        = 10;
+    static constexpr int waveTableSize        = 1 << waveTableBits;
+    static constexpr int subBlockSize         = 64;
+    static constexpr int maxNumSpikes         = 10000;
+    static constexpr int numInterleavedVoices = 4;
+    static constexpr double fadeOutSeconds    = 0.05;
+
+    enum class VoiceLayout
+    {
+        full,
+        compact
+    };
+
+    NeuronSynth();
+
+    void prepare(double sampleRate);
+
+    // Converts the state of all voices, so it can be switched while playing
+    void setVoiceLayout(VoiceLayout newLayout);
+    VoiceLayout getVoiceLayout() const { return layout; }
+
+    // Only the voices added or removed are affected, see above
+    void setNumVoices(int numVoices);
+    int getNumVoices() const { return numVoices; }
+
+    // Frequencies may come straight from the network. The kernels wrap the phase once per
+    // sample, so the frequency is kept in [0, Nyquist); anything that is not a number plays as 0 Hz.
+    void setFrequency(int voice, float frequency)
+    {
+        auto const highest = std::nextafter(static_cast<float>(sampleRate * 0.5), 0.f);
+        frequency          = std::isfinite(frequency) ? juce::jlimit(0.f, highest, frequency) : 0.f;
+
+        if (layout == VoiceLayout::compact)
+        {
+            compactVoices[voice].increment = encodeIncrement(frequency / sampleRate * 4294967296.0);
+            return;
+        }
+
+        increments[voice] = static_cast<float>(frequency * waveTableSize / sampleRate);
+    }
+
+    // Adds numSamples samples of the voices [0, numAudibleVoices) to left and
+    // right (right may be nullptr), pulling spikes from source as it goes.
+    // Returns the number of spikes that were triggered.
+    int render(float* left, float* right, int numSamples, int numAudibleVoices, SpikeSource& source);
+
+    EnvelopeBank env {};
+
+    // The sum of the squared envelope gains of all voices rendered by the
+    // last render(), averaged over its samples
+    float getEnvelopeEnergy() const { return envelopeEnergy; }
+
+    // Writes the loudest envelope gain of each of numBins equal groups of voices
+    void getPeakGains(float* dest, int numBins) const;
+
+    // See above, both take effect with the next render()
+    void setVoiceShare(float share) { voiceShare = juce::jlimit(0.f, 1.f, share); }
+    void setBlockRateEnvelopes(bool shouldUseBlockRate) { blockRateEnvelopes = shouldUseBlockRate; }
+
+    // Voices quieter than the loudest share that the last render() skipped
+    int getNumStolenVoices() const { return numStolenVoices; }
+
+    // Touches all voice state, see ThreadTuning::prefault()
+    void prefault() const;
+
+    int getVoiceTileSize() const { return voiceTileSize; }
+    int getSampleTileSize() const { return sampleTileSize; }
+
+private:
+    /*
+        gain holds log2 of the envelope gain in steps of 1/2048, offset by 8
+        octaves, with the top bit set while the voice is excited. A resting
+        voice plays at EnvelopeBank::defaultGain. The increment is a
+        mantissa of 12 bits and an exponent of 4 bits, see decodeIncrement().
+    */
+    struct CompactVoice
+    {
+        uint32_t phase;
+        uint16_t gain;
+        uint16_t increment;
+    };
+
+    static_assert(sizeof(CompactVoice) == 8, "CompactVoice must stay 8 bytes");
+
+    static constexpr uint16_t excitedFlag   = 0x8000;
+    static constexpr int gainStepsPerOctave = 2048;
+    static constexpr int gainOctaveOffset   = 8;
+    static constexpr int phaseShift         = 32 - waveTableBits;
+
+    // Half an octave each, from 2^-16 up to the gain limit
+    static constexpr int numGainBins   = 40;
+    static constexpr int firstGainBits = (127 - 16) << 1;
+
+    static uint16_t encodeIncrement(double increment);
+    static uint32_t decodeIncrement(uint16_t code)
+    {
+        return code == 0 ? 0u : (0x1000u | (code & 0xfffu)) << ((code >> 12) + 4);
+    }
+
+    // Back into [0, waveTableSize) after any number of turns
+    static float wrapPhase(float phase)
+    {
+        return phase - static_cast<float>(waveTableSize) * std::floor(phase * (1.f / waveTableSize));
+    }
+
+    uint16_t encodeGain(float gain) const;
+    float decodeGain(uint16_t code) const
+    {
+        auto const steps = code & ~excitedFlag;
+        return gainFractions[steps % gainStepsPerOctave] * gainOctaves[steps / gainStepsPerOctave];
+    }
+
+    static int getGainBin(float gain);
+    static float getGainBinFloor(int bin);
+    float getLoudness(int voice) const;
+    void chooseStealLevel(int numAudibleVoices);
+
+    void triggerCompact(int voice, float weight);
+    void advanceCompactGains(int numSamples, int numAudibleVoices);
+
+    void renderSubBlock(int numSamples, int numAudibleVoices);
+    void renderVoices(float* dest, int numSamples, int firstVoice, int endVoice);
+    void renderRetiringVoices(int numSamples);
+    void renderTile(float* dest, int numSamples, int firstVoice, int endVoice);
+    void renderCompactTile(float* dest, int offset, int numSamples, int firstVoice, int endVoice);
+    void chooseTileSizes();
+
+    double sampleRate {44100.0};
+    int numVoices {};
+    VoiceLayout layout {VoiceLayout::full};
+    int voiceTileSize {1024};
+    int sampleTileSize {16};
+
+    // Voices [retireBegin, retireEnd) are fading out for retireRemaining more samples
+    int lastNumAudible {};
+    int retireBegin {};
+    int retireEnd {};
+    int retireRemaining {};
+    int fadeOutSamples {2048};
+
+    double renderedEnergy {};
+    float envelopeEnergy {};
+
+    // Settled voices quieter than stealLevel are not rendered, see chooseStealLevel()
+    float voiceShare {1.f};
+    bool blockRateEnvelopes {};
+    float stealLevel {};
+    int numStolenVoices {};
+    std::array<int, numGainBins> gainHistogram {};
+
+    float waveTable[waveTableSize];
+
+    std::vector<float> phases;
+    std::vector<float> increments;
+
+    std::vector<CompactVoice> compactVoices;
+    float gainFractions[gainStepsPerOctave];
+    float gainOctaves[16];
+    float decayPowers[subBlockSize + 1] {};
+    double gainStepRemainder {};
+
+    alignas(64) float subBlock[subBlockSize] {};
+    alignas(64) float retireBlock[subBlockSize] {};
+
+    std::array<int, maxNumSpikes> spikingFrequencies {};
+    std::array<float, maxNumSpikes> spikeWeights {};
+    FastRandom phaseRandom {};
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//==============================================================================
+/*
+    Minimal OSC 1.0 packet parser that works in place on the received bytes.
+    It never allocates or copies: messages are handed to the handler as views
+    into the packet, and arguments are read on demand.
+
+    parse() walks messages and (nested) bundles and calls
+    handler.onMessage(OscDecoder::Message const&) for each message, with the
+    timetag of the innermost enclosing bundle. It returns false as soon as the
+    packet turns out to be malformed; messages before that point have already
+    been delivered.
+*/
+namespace OscDecoder
+{
+// The OSC timetag meaning "as soon as possible"
+static constexpr uint64_t immediately = 1;
+static constexpr int maxBundleDepth   = 8;
+
+inline uint32_t readBigEndian32(uint8_t const* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+           | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+inline uint64_t readBigEndian64(uint8_t const* p)
+{
+    return (static_cast<uint64_t>(readBigEndian32(p)) << 32) | readBigEndian32(p + 4);
+}
+
+inline size_t padded(size_t size) { return (size + 3) & ~static_cast<size_t>(3); }
+
+// Length of the OSC string at data, without its terminator, or -1 if it is not terminated within size
+inline long stringLength(uint8_t const* data, size_t size)
+{
+    auto const end = static_cast<uint8_t const*>(std::memchr(data, 0, size));
+    return end == nullptr ? -1 : static_cast<long>(end - data);
+}
+
+//==============================================================================
+class ArgumentReader
+{
+public:
+    ArgumentReader(char const* tags, size_t numTags, uint8_t const* data, size_t size)
+        : tags(tags)
+        , numTags(numTags)
+        , data(data)
+        , size(size)
+    {
+    }
+
+    bool atEnd() const { return tagIndex >= numTags; }
+    char nextType() const { return atEnd() ? '\0' : tags[tagIndex]; }
+
+    bool readInt32(int32_t& value)
+    {
+        if (nextType() != 'i' || !has(4)) { return false; }
+
+        value = static_cast<int32_t>(readBigEndian32(data + position));
+        advance(4);
+        return true;
+    }
+
+    bool readFloat(float& value)
+    {
+        if (nextType() != 'f' || !has(4)) { return false; }
+
+        auto const bits = readBigEndian32(data + position);
+        std::memcpy(&value, &bits, sizeof(value));
+        advance(4);
+        return true;
+    }
+
+    bool readBlob(uint8_t const*& blob, size_t& blobSize)
+    {
+        if (nextType() != 'b' || !has(4)) { return false; }
+
+        blobSize = readBigEndian32(data + position);
+        if (!has(4 + padded(blobSize))) { return false; }
+
+        blob = data + position + 4;
+        advance(4 + padded(blobSize));
+        return true;
+    }
+
+    // Steps over an argument of any supported type
+    bool skip()
+    {
+        switch (nextType())
+        {
+            case 'i':
+            case 'f':
+            case 'c':
+            case 'r':
+            case 'm': return has(4) && advance(4);
+            case 'h':
+            case 'd':
+            case 't': return has(8) && advance(8);
+            case 'T':
+            case 'F':
+            case 'N':
+            case 'I': return advance(0);
+            case 's':
+            case 'S':
+            {
+                auto const length = position < size ? stringLength(data + position, size - position) : -1;
+                return length >= 0 && advance(padded(static_cast<size_t>(length) + 1));
+            }
+            case 'b':
+            {
+                uint8_t const* blob = nullptr;
+                size_t blobSize     = 0;
+                return readBlob(blob, blobSize);
+            }
+            default: return false;
+        }
+    }
+
+private:
+    bool has(size_t numBytes) const { return position + numBytes <= size; }
+
+    bool advance(size_t numBytes)
+    {
+        position += numBytes;
+        tagIndex++;
+        return true;
+    }
+
+    char const* tags;
+    size_t numTags;
+    uint8_t const* data;
+    size_t size;
+    size_t position {};
+    size_t tagIndex {};
+};
+
+//==============================================================================
+struct Message
+{
+    char const* address;
+    size_t addressLength;
+    char const* typeTags;  // without the leading ','
+    size_t numArguments;
+    uint8_t const* arguments;
+    size_t argumentsSize;
+    uint64_t timetag;
+
+    bool addressIs(char const* other) const
+    {
+        return std::strlen(other) == addressLength && std::memcmp(address, other, addressLength) == 0;
+    }
+
+    ArgumentReader getArguments() const { return {typeTags, numArguments, arguments, argumentsSize}; }
+};
+
+inline bool isBundle(uint8_t const* data, size_t size) { return size >= 16 && std::memcmp(data, "#bundle", 8) == 0; }
+
+template <typename Handler>
+bool parse(uint8_t const* data, size_t size, Handler& handler, uint64_t timetag = immediately, int depth = 0)
+{
+    if (size == 0 || (size & 3) != 0) { return false; }
+
+    if (isBundle(data, size))
+    {
+        if (depth >= maxBundleDepth) { return false; }
+
+        auto const bundleTimetag = readBigEndian64(data + 8);
+        size_t position          = 16;
+
+        while (position < size)
+        {
+            if (position + 4 > size) { return false; }
+
+            auto const elementSize = static_cast<size_t>(readBigEndian32(data + position));
+            position += 4;
+
+            if (elementSize > size - position) { return false; }
+            if (!parse(data + position, elementSize, handler, bundleTimetag, depth + 1)) { return false; }
+
+            position += elementSize;
+        }
+
+        return true;
+    }
+
+    if (data[0] != '/') { return false; }
+
+    auto const addressLength = stringLength(data, size);
+    if (addressLength < 0) { return false; }
+
+    auto position = padded(static_cast<size_t>(addressLength) + 1);
+    if (position >= size || data[position] != ',') { return false; }
+
+    auto const tagsLength = stringLength(data + position, size - position);
+    if (tagsLength < 0) { return false; }
+
+    Message message;
+    message.address       = reinterpret_cast<char const*>(data);
+    message.addressLength = static_cast<size_t>(addressLength);
+    message.typeTags      = reinterpret_cast<char const*>(data + position + 1);
+    message.numArguments  = static_cast<size_t>(tagsLength) - 1;
+
+    position += padded(static_cast<size_t>(tagsLength) + 1);
+    if (position > size) { return false; }
+
+    message.arguments     = data + position;
+    message.argumentsSize = size - position;
+    message.timetag       = timetag;
+
+    handler.onMessage(message);
+    return true;
+}
+}  // namespace OscDecoder
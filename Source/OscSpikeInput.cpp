@@ -0,0 +1,205 @@
+#include "OscSpikeInput.h"
+
+#include <chrono>
+
+namespace
+{
+// Seconds between the NTP epoch (1900) and the unix epoch (1970)
+constexpr int64_t ntpToUnixSeconds = 2208988800;
+
+double nowNanos()
+{
+    using namespace std::chrono;
+    return static_cast<double>(duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count());
+}
+
+double timetagToNanos(uint64_t timetag)
+{
+    // Signed, a timetag from before 1970 is simply in the past
+    auto const seconds  = static_cast<double>(static_cast<int64_t>(timetag >> 32) - ntpToUnixSeconds);
+    auto const fraction = static_cast<double>(timetag & 0xffffffffull) / 4294967296.0;
+    return (seconds + fraction) * 1.0e9;
+}
+
+struct PacketHandler
+{
+    OscSpikeInput& input;
+    void onMessage(OscDecoder::Message const& message) { input.handleMessage(message); }
+};
+}  // namespace
+
+OscSpikeInput::OscSpikeInput(ThreadTuning& tuning)
+    : threadTuning(tuning)
+{
+}
+
+OscSpikeInput::~OscSpikeInput() { stop(); }
+
+juce::Result OscSpikeInput::start(int port)
+{
+    stop();
+
+    // A fresh socket every time, the old one is shut down and cannot be bound again
+    socket = std::make_unique<juce::DatagramSocket>();
+
+    if (!socket->bindToPort(port))
+    {
+        socket.reset();
+        return juce::Result::fail("Could not bind OSC port " + juce::String(port));
+    }
+
+    running.store(true);
+    receiveThread = std::thread([this] { run(); });
+    return juce::Result::ok();
+}
+
+void OscSpikeInput::stop()
+{
+    running.store(false);
+
+    // Releases the port and wakes the receive thread from its wait
+    if (socket != nullptr) { socket->shutdown(); }
+    if (receiveThread.joinable()) { receiveThread.join(); }
+
+    socket.reset();
+}
+
+void OscSpikeInput::prepare(double newSampleRate, int maxBlockSize)
+{
+    sampleRate.store(newSampleRate);
+    blockSize.store(maxBlockSize);
+}
+
+void OscSpikeInput::run()
+{
+    threadTuning.applyToCurrentThread(ThreadTuning::Role::receiver, 0);
+
+    PacketHandler handler {*this};
+    uint8_t buffer[65536];
+
+    while (running.load())
+    {
+        // Wake up regularly to notice stop()
+        if (socket->waitUntilReady(true, 100) != 1) { continue; }
+
+        auto const numBytes = socket->read(buffer, sizeof(buffer), false);
+        if (numBytes <= 0) { continue; }
+
+        if (!OscDecoder::parse(buffer, static_cast<size_t>(numBytes), handler))
+        { numMalformedPackets.fetch_add(1, std::memory_order_relaxed); }
+    }
+}
+
+void OscSpikeInput::handleMessage(OscDecoder::Message const& message)
+{
+    auto const wide = message.addressIs("/spike32");
+    if (!wide && !message.addressIs("/spike")) { return; }
+
+    auto const dueSample = timetagToSample(message.timetag);
+    auto arguments       = message.getArguments();
+
+    while (!arguments.atEnd())
+    {
+        int32_t index       = 0;
+        uint8_t const* blob = nullptr;
+        size_t blobSize     = 0;
+
+        if (arguments.readInt32(index))
+        {
+            if (index >= 0) { pushSpike(static_cast<uint32_t>(index), dueSample); }
+        }
+        else if (arguments.readBlob(blob, blobSize))
+        {
+            if (wide)
+            {
+                for (size_t i = 0; i + 4 <= blobSize; i += 4)
+                { pushSpike(OscDecoder::readBigEndian32(blob + i), dueSample); }
+            }
+            else
+            {
+                for (size_t i = 0; i + 2 <= blobSize; i += 2)
+                { pushSpike(static_cast<uint32_t>((blob[i] << 8) | blob[i + 1]), dueSample); }
+            }
+        }
+        else if (!arguments.skip())
+        {
+            numMalformedPackets.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+void OscSpikeInput::pushSpike(uint32_t index, int64_t dueSample)
+{
+    if (dueSample == beyondHorizon || !queue.try_enqueue({index, dueSample}))
+    { numSpikesDropped.fetch_add(1, std::memory_order_relaxed); }
+}
+
+int64_t OscSpikeInput::timetagToSample(uint64_t timetag) const
+{
+    if (timetag == OscDecoder::immediately) { return -1; }
+
+    auto const origin = sampleZeroNanos.load();
+    if (origin == 0.0) { return -1; }
+
+    // Past timetags are due now, and nothing is held back for longer than maxScheduleSeconds
+    auto const nanos = timetagToNanos(timetag);
+    if (nanos > nowNanos() + maxScheduleSeconds * 1.0e9) { return beyondHorizon; }
+    if (nanos <= origin) { return -1; }
+
+    // A block of extra latency, so that spikes stamped "now" by the sender still land on their sample
+    auto const rate = sampleRate.load();
+    return static_cast<int64_t>((nanos - origin) * 1.0e-9 * rate) + blockSize.load(std::memory_order_relaxed);
+}
+
+int OscSpikeInput::pullSpikes(int numSamples, int numNeurons, int* dest, int maxSpikes)
+{
+    // Keep the audio clock in sync with the wall clock. Callbacks jitter, so
+    // only follow the measured origin slowly once the first estimate is in.
+    auto const rate           = sampleRate.load();
+    auto const measuredOrigin = nowNanos() - static_cast<double>(blockStartSample) / rate * 1.0e9;
+    auto const origin         = sampleZeroNanos.load();
+    sampleZeroNanos.store(origin == 0.0 ? measuredOrigin : origin + 0.01 * (measuredOrigin - origin));
+
+    auto const blockEnd = blockStartSample + numSamples;
+    blockStartSample    = blockEnd;
+
+    int numSpikes = 0;
+
+    auto emit = [&](TimedSpike const& spike) {
+        if (spike.index < static_cast<uint32_t>(numNeurons) && numSpikes < maxSpikes)
+        { dest[numSpikes++] = static_cast<int>(spike.index); }
+    };
+
+    // Held back spikes that are now due
+    for (int i = 0; i < numPending;)
+    {
+        if (pending[i].dueSample < blockEnd)
+        {
+            emit(pending[i]);
+            pending[i] = pending[--numPending];
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    TimedSpike spike {};
+
+    while (numSpikes < maxSpikes && queue.try_dequeue(spike))
+    {
+        if (spike.dueSample < blockEnd) { emit(spike); }
+        else if (numPending < static_cast<int>(pending.size()))
+        {
+            pending[numPending++] = spike;
+        }
+        else
+        {
+            // No room to wait, better early than never
+            emit(spike);
+        }
+    }
+
+    return numSpikes;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "OscDecoder.h"
+#include "SpikeSource.h"
+#include "ThreadTuning.h"
+#include "readerwriterqueue.h"
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+//==============================================================================
+/*
+    Spike input speaking plain OSC over UDP, so that Max, SuperCollider,
+    python-osc and friends can drive the engine directly. Understood are
+
+        /spike   ,i...   one spike per int argument
+        /spike   ,b      blob of big endian 16 bit neuron indices
+        /spike32 ,b      blob of big endian 32 bit neuron indices
+
+    either on their own or inside (nested) bundles. Packets are parsed in place
+    on the receive thread and the spikes go straight into a lock free queue,
+    nothing passes through the message thread.
+
+    Bundle timetags are translated to a position on the audio clock: spikes
+    scheduled in the future are held back until the block that contains their
+    sample position, spikes that are already due are played in the next block.
+    Spikes scheduled more than maxScheduleSeconds ahead are dropped and
+    counted, so a sender with a broken clock cannot fill up the spikes held
+    back for later.
+*/
+class OscSpikeInput : public SpikeSource
+{
+public:
+    static constexpr int defaultPort           = 9001;
+    static constexpr double maxScheduleSeconds = 1.0;
+
+    explicit OscSpikeInput(ThreadTuning& threadTuning);
+    ~OscSpikeInput() override;
+
+    juce::Result start(int port = defaultPort);
+    void stop();
+    bool isRunning() const { return running.load(); }
+
+    void prepare(double sampleRate, int maxBlockSize) override;
+    int pullSpikes(int numSamples, int numNeurons, int* dest, int maxSpikes) override;
+
+    uint64_t getNumMalformedPackets() const { return numMalformedPackets.load(std::memory_order_relaxed); }
+    uint64_t getNumSpikesDropped() const { return numSpikesDropped.load(std::memory_order_relaxed); }
+
+    // Used by the packet handler on the receive thread
+    void handleMessage(OscDecoder::Message const& message);
+
+private:
+    struct TimedSpike
+    {
+        uint32_t index;
+        int64_t dueSample;  // -1 for as soon as possible
+    };
+
+    // Due sample of a spike too far ahead to be held back
+    static constexpr int64_t beyondHorizon = -2;
+
+    void run();
+    void pushSpike(uint32_t index, int64_t dueSample);
+    int64_t timetagToSample(uint64_t timetag) const;
+
+    ThreadTuning& threadTuning;
+    std::unique_ptr<juce::DatagramSocket> socket;
+    std::thread receiveThread;
+    std::atomic<bool> running {false};
+
+    moodycamel::ReaderWriterQueue<TimedSpike> queue {1 << 14};
+
+    // Audio clock: the wall clock time of sample 0, in nanoseconds since the unix epoch
+    std::atomic<double> sampleZeroNanos {0.0};
+    std::atomic<double> sampleRate {44100.0};
+    int64_t blockStartSample {};
+    std::atomic<int> blockSize {512};
+
+    // Spikes whose time has not come yet, only touched by the audio thread
+    std::array<TimedSpike, 4096> pending {};
+    int numPending {};
+
+    std::atomic<uint64_t> numMalformedPackets {0};
+    std::atomic<uint64_t> numSpikesDropped {0};
+};
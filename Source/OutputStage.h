@@ -0,0 +1,80 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+
+//==============================================================================
+/*
+    The last thing the mix goes through before it reaches the device.
+
+    First the level is normalised: the sum of the squared envelope gains says
+    how loud the incoherent sum of all voices is going to be, so once that
+    passes referenceRms the mix is turned down to it, smoothly and before any
+    sample clips. The caller's gain (the master slider) is applied with it.
+
+    Then a true-peak limiter with a fixed lookahead keeps the output below
+    ceiling. Peaks between samples are estimated by 4x polyphase
+    interpolation, which is accurate to a fraction of a decibel for content
+    below about 0.8 of Nyquist and underestimates above that. The gain needed
+    for every sample is held for the lookahead, released slowly and then
+    averaged over the lookahead, which makes the gain reach its target exactly
+    when the peak leaves the delay line, so the ceiling holds without clipping
+    and without clicks.
+
+    Everything runs in chunks of fixed size on preallocated arrays; the window
+    loops are plain contiguous min and sum loops that the compiler vectorises.
+*/
+class OutputStage
+{
+public:
+    static constexpr int maxNumChannels    = 2;
+    static constexpr int lookahead         = 64;
+    static constexpr int oversampling      = 4;
+    static constexpr int tapsPerPhase      = 12;
+    static constexpr int filterDelay       = tapsPerPhase / 2;
+    static constexpr int latency           = lookahead + filterDelay;
+    static constexpr float ceiling         = 0.891f;  // -1 dBTP
+    static constexpr float referenceRms    = 0.5f;
+    static constexpr double releaseSeconds = 0.08;
+    static constexpr double levelSeconds   = 0.05;
+
+    OutputStage();
+
+    void prepare(double sampleRate);
+    void reset();
+
+    // Applies gain, normalisation and limiting in place. envelopeEnergy is
+    // the sum of the squared envelope gains of the voices in this block.
+    void process(float* const* channels, int numChannels, int numSamples, float gain, float envelopeEnergy);
+
+    // For meters, safe to read from any thread
+    float getGainReductionDb() const { return gainReductionDb.load(std::memory_order_relaxed); }
+    float getNormalisationGain() const { return normalisationGain.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr int chunkSize = 256;
+
+    void processChunk(float* const* channels, int numChannels, int numSamples);
+
+    double sampleRate {44100.0};
+    float releaseCoefficient {};
+    float currentGain {1.f};
+    float currentNormalisation {1.f};
+    float envelope {1.f};
+
+    // Polyphase interpolation filter, phase p uses filter[p][0 .. tapsPerPhase)
+    std::array<std::array<float, tapsPerPhase>, oversampling> filter {};
+
+    // Every history keeps the end of the previous chunk in front of the current one
+    std::array<std::array<float, tapsPerPhase - 1 + chunkSize>, maxNumChannels> input {};
+    std::array<std::array<float, latency + chunkSize>, maxNumChannels> delay {};
+    std::array<float, lookahead + chunkSize> required {};
+    std::array<float, lookahead - 1 + chunkSize> released {};
+    std::array<float, chunkSize> peaks {};
+    std::array<float, chunkSize> gains {};
+
+    std::atomic<float> gainReductionDb {0.f};
+    std::atomic<float> normalisationGain {1.f};
+};
@@ -0,0 +1,93 @@
+#include "RandomSpikeSource.h"
+
+#include <algorithm>
+#include <cmath>
+
+RandomSpikeSource::RandomSpikeSource(int maxNumNeurons, uint64_t seed)
+    : random(seed)
+    , neuronRates(static_cast<size_t>(maxNumNeurons), 0.f)
+    , randomBlock(static_cast<size_t>(maxNumNeurons), 0u)
+{
+}
+
+void RandomSpikeSource::prepare(double newSampleRate, int) { sampleRate = newSampleRate; }
+
+void RandomSpikeSource::setNeuronRates(std::vector<float> const& ratesHz)
+{
+    usePerNeuronRates = !ratesHz.empty();
+
+    auto const numRates = std::min(ratesHz.size(), neuronRates.size());
+    std::fill(neuronRates.begin(), neuronRates.end(), rate.load());
+    std::copy(ratesHz.begin(), ratesHz.begin() + static_cast<long>(numRates), neuronRates.begin());
+}
+
+int RandomSpikeSource::pullSpikes(int numSamples, int numNeurons, int* dest, int maxSpikes)
+{
+    auto const seed = pendingSeed.exchange(0);
+    if (seed != 0) { random.setSeed(seed); }
+
+    numNeurons = std::min(numNeurons, static_cast<int>(neuronRates.size()));
+    if (numNeurons <= 0 || numSamples <= 0 || maxSpikes <= 0) { return 0; }
+
+    return usePerNeuronRates ? pullPerNeuron(numSamples, numNeurons, dest, maxSpikes)
+                             : pullShared(numSamples, numNeurons, dest, maxSpikes);
+}
+
+int RandomSpikeSource::pullShared(int numSamples, int numNeurons, int* dest, int maxSpikes)
+{
+    // The sum of independent Poisson processes is Poisson with the summed rate,
+    // and each event is equally likely to belong to any of the neurons
+    auto const blockDuration = static_cast<float>(numSamples / sampleRate);
+    auto const numSpikes     = std::min(drawPoisson(rate.load() * blockDuration * numNeurons), maxSpikes);
+
+    random.fillIndices(dest, numSpikes, numNeurons);
+    return numSpikes;
+}
+
+int RandomSpikeSource::pullPerNeuron(int numSamples, int numNeurons, int* dest, int maxSpikes)
+{
+    // Probability of a spike within the block, as a threshold on a 24 bit draw
+    auto const scale = static_cast<float>(numSamples / sampleRate) * 16777216.f;
+
+    random.fill(randomBlock.data(), numNeurons);
+
+    int numSpikes = 0;
+    for (int i = 0; i < numNeurons && numSpikes < maxSpikes; i++)
+    {
+        auto const threshold = neuronRates[i] * scale;
+
+        // Branch free compaction: always write, only advance on a hit
+        dest[numSpikes] = i;
+        numSpikes += static_cast<float>(randomBlock[i] >> 8) < threshold ? 1 : 0;
+    }
+
+    return numSpikes;
+}
+
+int RandomSpikeSource::drawPoisson(float mean)
+{
+    if (mean <= 0.f) { return 0; }
+
+    if (mean < 30.f)
+    {
+        // Knuth: multiply uniforms until the product drops below e^-mean
+        auto const limit = std::exp(-mean);
+        auto product     = random.nextFloat();
+        int count        = 0;
+
+        while (product > limit)
+        {
+            product *= random.nextFloat();
+            count++;
+        }
+
+        return count;
+    }
+
+    // Normal approximation is accurate enough for larger means, Box-Muller for the gaussian
+    auto const u1    = std::max(random.nextFloat(), 1.0e-7f);
+    auto const u2    = random.nextFloat();
+    auto const gauss = std::sqrt(-2.f * std::log(u1)) * std::cos(6.28318530718f * u2);
+
+    return std::max(0, static_cast<int>(std::lround(mean + std::sqrt(mean) * gauss)));
+}
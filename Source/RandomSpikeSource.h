@@ -0,0 +1,53 @@
+#pragma once
+
+#include "FastRandom.h"
+#include "SpikeSource.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+//==============================================================================
+/*
+    Test pattern source: every neuron fires as an independent Poisson process.
+
+    With one shared rate the number of spikes per block is drawn from a single
+    Poisson distribution and the indices are generated in bulk, so the cost is
+    proportional to the number of spikes, not to the number of neurons. With
+    per-neuron rates every neuron gets one uniform draw per block, compared
+    against its own firing probability.
+*/
+class RandomSpikeSource : public SpikeSource
+{
+public:
+    explicit RandomSpikeSource(int maxNumNeurons, uint64_t seed = 1);
+
+    void prepare(double sampleRate, int maxBlockSize) override;
+    int pullSpikes(int numSamples, int numNeurons, int* dest, int maxSpikes) override;
+
+    // Firing rate in Hz used for every neuron without an individual rate
+    void setRate(float ratePerNeuronHz) { rate.store(ratePerNeuronHz); }
+    float getRate() const { return rate.load(); }
+
+    // Per-neuron rates in Hz, an empty vector switches back to the shared rate.
+    // Must not be called while the audio thread is pulling from this source.
+    void setNeuronRates(std::vector<float> const& ratesHz);
+
+    // Restarts the sequence, takes effect at the next pullSpikes()
+    void setSeed(uint64_t newSeed) { pendingSeed.store(newSeed); }
+
+private:
+    int pullShared(int numSamples, int numNeurons, int* dest, int maxSpikes);
+    int pullPerNeuron(int numSamples, int numNeurons, int* dest, int maxSpikes);
+    int drawPoisson(float mean);
+
+    FastRandom random;
+    double sampleRate {44100.0};
+
+    std::atomic<float> rate {20.f};
+    std::atomic<uint64_t> pendingSeed {0};
+
+    bool usePerNeuronRates {false};
+    std::vector<float> neuronRates;
+    std::vector<uint32_t> randomBlock;
+};
@@ -0,0 +1,599 @@
+#include "RenderCluster.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+// Samples at sampleRate since the unix epoch, the timeline all nodes share
+uint64_t getWallClockFrames(double sampleRate)
+{
+    auto const nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+
+    return static_cast<uint64_t>(static_cast<double>(nanos) * 1.0e-9 * sampleRate);
+}
+
+uint64_t getWallClockNanos()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::system_clock::now().time_since_epoch())
+                                     .count());
+}
+}  // namespace
+
+//==============================================================================
+ClusterSettings ClusterSettings::parseCommandLine(juce::String const& commandLine)
+{
+    ClusterSettings settings;
+    bool shardGiven = false;
+
+    for (auto const& argument : juce::StringArray::fromTokens(commandLine, " ", "\""))
+    {
+        auto const value = argument.fromFirstOccurrenceOf("=", false, false);
+
+        if (argument.startsWith("--shard="))
+        {
+            auto const first = value.upToFirstOccurrenceOf("-", false, false).getIntValue();
+            auto const end   = value.fromFirstOccurrenceOf("-", false, false).getIntValue();
+
+            settings.shardFirst = std::max(0, first);
+            settings.shardEnd   = std::max(settings.shardFirst, end);
+            shardGiven          = true;
+        }
+
+        if (argument.startsWith("--mix-to="))
+        {
+            settings.mixerHost = value.upToLastOccurrenceOf(":", false, false);
+            settings.mixerPort = juce::jlimit(0, 65535, value.fromLastOccurrenceOf(":", false, false).getIntValue());
+        }
+
+        if (argument.startsWith("--mix-format=")) { settings.rtp = value == "rtp"; }
+        if (argument.startsWith("--mix-port=")) { settings.mixPort = juce::jlimit(0, 65535, value.getIntValue()); }
+        if (argument.startsWith("--jitter-ms=")) { settings.jitterMs = juce::jlimit(1, 150, value.getIntValue()); }
+        if (argument.startsWith("--spike-ports=")) { settings.spikePorts = value; }
+        if (argument == "--headless") { settings.headless = true; }
+
+        if (argument.startsWith("--headless-rate="))
+        { settings.headlessRate = juce::jlimit(8000.0, 192000.0, value.getDoubleValue()); }
+
+        if (argument.startsWith("--headless-block="))
+        { settings.headlessBlockSize = juce::jlimit(16, 4096, value.getIntValue()); }
+    }
+
+    // A mixer that was not given a shard of its own only mixes
+    if (settings.mixPort > 0 && !shardGiven) { settings.shardEnd = 0; }
+
+    return settings;
+}
+
+juce::String ClusterSettings::getDescription() const
+{
+    juce::StringArray parts;
+
+    auto const range = juce::String(shardFirst) + "-" + juce::String(shardEnd);
+
+    if (isSharded() && shardEnd > shardFirst) { parts.add("shard " + range); }
+    if (mixerPort > 0) { parts.add("to " + mixerHost + ":" + juce::String(mixerPort) + (rtp ? " as RTP" : "")); }
+    if (mixPort > 0) { parts.add("mixing on :" + juce::String(mixPort)); }
+
+    if (headless) { parts.add("headless at " + juce::String(headlessRate) + " Hz"); }
+
+    return parts.joinIntoString(" ");
+}
+
+//==============================================================================
+int ShardSpikeSource::pullWeightedSpikes(int numSamples, int, int* dest, float* weights, int maxSpikes)
+{
+    if (source == nullptr) { return 0; }
+
+    auto const numPulled = source->pullWeightedSpikes(numSamples, numTotalNeurons, dest, weights, maxSpikes);
+    int numKept          = 0;
+
+    for (int i = 0; i < numPulled; i++)
+    {
+        if (dest[i] < first || dest[i] >= end) { continue; }
+
+        dest[numKept] = dest[i] - first;
+        if (weights != nullptr) { weights[numKept] = weights[i]; }
+        numKept++;
+    }
+
+    return numKept;
+}
+
+//==============================================================================
+ShardSender::ShardSender(ThreadTuning& tuning)
+    : threadTuning(tuning)
+{
+}
+
+ShardSender::~ShardSender() { stop(); }
+
+juce::Result ShardSender::start(juce::String const& newHost, int newPort, int newShard, Format newFormat)
+{
+    stop();
+
+    host   = newHost;
+    port   = newPort;
+    shard  = static_cast<uint16_t>(newShard);
+    format = newFormat;
+    udp    = std::make_unique<juce::DatagramSocket>();
+
+    if (host.isEmpty() || port <= 0)
+    {
+        udp.reset();
+        return juce::Result::fail("No mixer to send the shard to");
+    }
+
+    stopRequested.store(false);
+    senderThread = std::thread([this] { run(); });
+    running.store(true);
+    return juce::Result::ok();
+}
+
+void ShardSender::stop()
+{
+    running.store(false);
+
+    if (senderThread.joinable())
+    {
+        stopRequested.store(true);
+        senderThread.join();
+    }
+
+    udp.reset();
+}
+
+void ShardSender::prepare(double newSampleRate)
+{
+    sampleRate.store(newSampleRate);
+    anchored = false;
+}
+
+void ShardSender::push(float const* samples, int numSamples, float energy)
+{
+    auto const rate      = sampleRate.load(std::memory_order_relaxed);
+    auto const now       = getWallClockFrames(rate);
+    auto const tolerance = static_cast<int64_t>(driftToleranceSeconds * rate);
+    auto const drift     = static_cast<int64_t>(pending.position + static_cast<uint64_t>(pendingSize) - now);
+
+    if (!anchored || std::abs(drift) > tolerance)
+    {
+        if (anchored) { numResyncs.fetch_add(1, std::memory_order_relaxed); }
+
+        // Cells stay aligned to the timeline, so the stream may start in the middle of one
+        pending.position = now - now % clusterCellSize;
+        pendingSize      = static_cast<int>(now - pending.position);
+        anchored         = true;
+        std::fill(pending.samples, pending.samples + pendingSize, 0.f);
+    }
+
+    for (int offset = 0; offset < numSamples;)
+    {
+        auto const numToCopy = std::min(numSamples - offset, clusterCellSize - pendingSize);
+
+        std::copy(samples + offset, samples + offset + numToCopy, pending.samples + pendingSize);
+        pendingSize += numToCopy;
+        offset += numToCopy;
+
+        if (pendingSize < clusterCellSize) { break; }
+
+        // The queue never grows, a cell that does not fit is counted and lost
+        pending.energy = energy;
+        if (!queue.try_enqueue(pending)) { numCellsDropped.fetch_add(1, std::memory_order_relaxed); }
+
+        pending.position += clusterCellSize;
+        pendingSize = 0;
+    }
+}
+
+void ShardSender::run()
+{
+    static constexpr int cellsPerPacket = maxAudioFrames / clusterCellSize;
+
+    threadTuning.applyToCurrentThread(ThreadTuning::Role::worker);
+
+    DBG("Sending shard " << static_cast<int>(shard) << " to " << host << ":" << port);
+
+    // What an RTP receiver has to be told in its SDP. Logged in release builds too, a headless
+    // node has no other way of telling anyone.
+    if (format == Format::rtp)
+    {
+        auto const payloadType = juce::String(static_cast<int>(rtpPayloadType));
+
+        juce::Logger::writeToLog("m=audio " + juce::String(port) + " RTP/AVP " + payloadType + "\n" + "a=rtpmap:"
+                                 + payloadType + " L16/" + juce::String(std::lround(sampleRate.load())) + "/1");
+    }
+
+    Cell cells[cellsPerPacket];
+    Cell next {};
+    int numCells = 0;
+
+    while (!stopRequested.load())
+    {
+        while (queue.try_dequeue(next))
+        {
+            // A packet only holds consecutive cells
+            if (numCells > 0 && next.position != cells[numCells - 1].position + clusterCellSize)
+            {
+                send(cells, numCells);
+                numCells = 0;
+            }
+
+            cells[numCells++] = next;
+
+            if (numCells == cellsPerPacket)
+            {
+                send(cells, numCells);
+                numCells = 0;
+            }
+        }
+
+        if (numCells > 0)
+        {
+            send(cells, numCells);
+            numCells = 0;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void ShardSender::send(Cell const* cells, int numCells)
+{
+    uint8_t packet[packetHeaderSize + packetTimeSize + audioHeaderSize + maxAudioFrames * 4];
+
+    auto const size = format == Format::rtp ? writeRtpPacket(packet, cells, numCells)
+                                            : writeCellPacket(packet, cells, numCells);
+
+    if (udp->write(host, port, packet, static_cast<int>(size)) > 0)
+    { numPacketsSent.fetch_add(1, std::memory_order_relaxed); }
+}
+
+size_t ShardSender::writeCellPacket(uint8_t* packet, Cell const* cells, int numCells)
+{
+    auto const numFrames = static_cast<uint16_t>(numCells * clusterCellSize);
+    auto const rate      = static_cast<uint32_t>(std::lround(sampleRate.load()));
+    auto const flags     = PacketFlags::timestamped;
+    float energy         = 0.f;
+
+    for (int c = 0; c < numCells; c++) { energy += cells[c].energy; }
+    energy /= static_cast<float>(numCells);
+
+    auto size = writePacketHeader(packet, {protocolVersion, flags, PacketType::audio, numFrames, sequence++,
+                                           getWallClockNanos()});
+    size += writeAudioBlockHeader(packet + size, {cells[0].position, rate, shard, energy});
+
+    for (int c = 0; c < numCells; c++)
+    {
+        for (auto const sample : cells[c].samples)
+        {
+            uint32_t bits = 0;
+            std::memcpy(&bits, &sample, sizeof(bits));
+            for (int i = 0; i < 4; i++) { packet[size++] = static_cast<uint8_t>(bits >> (8 * i)); }
+        }
+    }
+
+    return size;
+}
+
+size_t ShardSender::writeRtpPacket(uint8_t* packet, Cell const* cells, int numCells)
+{
+    // RTP is big endian throughout
+    auto const put = [&packet](uint32_t value, int numBytes) {
+        for (int i = numBytes - 1; i >= 0; i--) { *packet++ = static_cast<uint8_t>(value >> (8 * i)); }
+    };
+
+    put(0x80, 1);  // version 2, no padding, extension or CSRCs
+    put(rtpPayloadType, 1);
+    put(sequence++ & 0xffff, 2);
+    put(static_cast<uint32_t>(cells[0].position), 4);
+    put(0x4f570000u | shard, 4);  // SSRC, "OW" and the shard
+
+    for (int c = 0; c < numCells; c++)
+    {
+        for (auto const sample : cells[c].samples)
+        {
+            auto const value = juce::jlimit(-32768.f, 32767.f, std::round(sample * 32767.f));
+            put(static_cast<uint16_t>(static_cast<int16_t>(value)), 2);
+        }
+    }
+
+    return rtpHeaderSize + static_cast<size_t>(numCells * clusterCellSize * 2);
+}
+
+//==============================================================================
+ShardMixer::ShardMixer(ThreadTuning& tuning)
+    : threadTuning(tuning)
+{
+    for (auto& shard : shards) { shard = std::make_unique<Shard>(); }
+}
+
+ShardMixer::~ShardMixer() { stop(); }
+
+juce::Result ShardMixer::start(int portToBind)
+{
+    stop();
+
+    port = portToBind;
+    udp  = std::make_unique<juce::DatagramSocket>();
+
+    if (!udp->bindToPort(port, "0.0.0.0"))
+    {
+        udp.reset();
+        return juce::Result::fail("Could not bind mixer port " + juce::String(port));
+    }
+
+    stopRequested.store(false);
+    receiverThread = std::thread([this] { run(); });
+    running.store(true);
+    return juce::Result::ok();
+}
+
+void ShardMixer::stop()
+{
+    running.store(false);
+
+    if (receiverThread.joinable())
+    {
+        stopRequested.store(true);
+        receiverThread.join();
+    }
+
+    udp.reset();
+}
+
+void ShardMixer::prepare(double newSampleRate, int jitterMs)
+{
+    sampleRate.store(newSampleRate);
+    jitterFrames = static_cast<uint64_t>(jitterMs * 0.001 * newSampleRate);
+    playPosition = 0;
+}
+
+void ShardMixer::run()
+{
+    threadTuning.applyToCurrentThread(ThreadTuning::Role::receiver);
+
+    DBG("Mixing shards arriving on port " << port);
+
+    uint8_t buffer[5000] = {};
+
+    while (!stopRequested.load())
+    {
+        if (udp->waitUntilReady(true, 50) != 1) { continue; }
+
+        for (;;)
+        {
+            auto const numBytes = udp->read(buffer, sizeof(buffer), false);
+            if (numBytes <= 0) { break; }
+
+            if (SpikeDecoder::decode(buffer, static_cast<size_t>(numBytes), *this) != SpikeDecoder::Error::none)
+            { numRejectedPackets.fetch_add(1, std::memory_order_relaxed); }
+        }
+    }
+}
+
+void ShardMixer::onPacket(PacketHeader const& header)
+{
+    if ((header.flags & PacketFlags::timestamped) == 0) { return; }
+
+    streamCounters.addLatency(static_cast<int64_t>(getWallClockNanos()) - static_cast<int64_t>(header.sendTimeNanos));
+}
+
+void ShardMixer::onAudio(PacketHeader const& header, AudioBlockHeader const& block, SpikeDecoder::ByteView samples)
+{
+    // Blocks only line up with others at the same rate and on the same cell grid
+    auto const rate = static_cast<uint32_t>(std::lround(sampleRate.load()));
+
+    if (block.sampleRate != rate || block.position % clusterCellSize != 0 || header.count % clusterCellSize != 0)
+    {
+        numRejectedPackets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // A single NaN would stay in the output stage's running gains for good, so the whole packet goes
+    auto finite = std::isfinite(block.energy);
+    for (size_t i = 0; finite && i < header.count; i++) { finite = std::isfinite(samples.readFloat(i * 4)); }
+
+    if (!finite)
+    {
+        numRejectedPackets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    sequenceTracker.track(block.shard, header.sequence, streamCounters);
+    numPacketsReceived.fetch_add(1, std::memory_order_relaxed);
+
+    auto const played = readPosition.load(std::memory_order_acquire);
+    auto const end    = block.position + header.count;
+
+    if (played > 0 && end <= played)
+    {
+        numLatePackets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Further ahead than the buffer reaches, the clocks of the two nodes are far apart
+    auto* shard = findShard(block.shard, block.position);
+
+    if (shard == nullptr || (played > 0 && end > played + numCells * clusterCellSize))
+    {
+        numRejectedPackets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    for (size_t offset = 0; offset < header.count; offset += clusterCellSize)
+    {
+        auto const position = block.position + offset;
+        auto& cell          = shard->cells[(position / clusterCellSize) % numCells];
+
+        cell.position.store(noPosition, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        cell.energy = std::max(0.f, block.energy);
+        for (int i = 0; i < clusterCellSize; i++) { cell.samples[i] = samples.readFloat((offset + i) * 4); }
+
+        cell.position.store(position, std::memory_order_release);
+    }
+
+    if (end > shard->lastPosition.load(std::memory_order_relaxed))
+    { shard->lastPosition.store(end, std::memory_order_relaxed); }
+}
+
+ShardMixer::Shard* ShardMixer::findShard(int id, uint64_t position)
+{
+    auto const played = readPosition.load(std::memory_order_relaxed);
+    Shard* unused     = nullptr;
+
+    for (auto& shard : shards)
+    {
+        if (shard->id.load(std::memory_order_relaxed) == id) { return shard.get(); }
+        if (unused == nullptr && !isActive(*shard, played)) { unused = shard.get(); }
+    }
+
+    if (unused != nullptr)
+    {
+        DBG("Shard " << id << " joined");
+        unused->firstPosition.store(position, std::memory_order_relaxed);
+        unused->lastPosition.store(position, std::memory_order_relaxed);
+        unused->id.store(id, std::memory_order_relaxed);
+    }
+
+    return unused;
+}
+
+bool ShardMixer::isActive(Shard const& shard, uint64_t position) const
+{
+    return shard.id.load(std::memory_order_relaxed) >= 0
+           && shard.lastPosition.load(std::memory_order_relaxed) + static_cast<uint64_t>(sampleRate.load()) >= position;
+}
+
+int ShardMixer::getNumActiveShards() const
+{
+    auto const position = readPosition.load(std::memory_order_relaxed);
+    return static_cast<int>(std::count_if(shards.begin(), shards.end(),
+                                          [&](auto const& shard) { return isActive(*shard, position); }));
+}
+
+float ShardMixer::mix(float* left, float* right, int numSamples)
+{
+    auto const rate      = sampleRate.load(std::memory_order_relaxed);
+    auto const target    = getWallClockFrames(rate) - jitterFrames;
+    auto const tolerance = static_cast<int64_t>(ShardSender::driftToleranceSeconds * rate);
+
+    if (playPosition == 0 || std::abs(static_cast<int64_t>(playPosition - target)) > tolerance)
+    {
+        if (playPosition != 0) { numResyncs.fetch_add(1, std::memory_order_relaxed); }
+        playPosition = target;
+    }
+
+    auto const end = playPosition + static_cast<uint64_t>(numSamples);
+    float cellSamples[clusterCellSize];
+    double energy = 0.0;
+
+    for (auto const& shard : shards)
+    {
+        if (shard->id.load(std::memory_order_relaxed) < 0) { continue; }
+
+        // Nothing is missing from before a shard's first packet
+        auto const active = isActive(*shard, playPosition)
+                            && shard->firstPosition.load(std::memory_order_relaxed) <= playPosition;
+
+        for (auto position = playPosition; position < end;)
+        {
+            auto const cellStart = position - position % clusterCellSize;
+            auto const offset    = static_cast<int>(position - cellStart);
+            auto const numToMix  = static_cast<int>(std::min(end, cellStart + clusterCellSize) - position);
+            auto const& cell     = shard->cells[(cellStart / clusterCellSize) % numCells];
+            auto const index     = static_cast<int>(position - playPosition);
+
+            // Copied first and only used if the receiver did not touch the cell meanwhile
+            auto const before = cell.position.load(std::memory_order_acquire);
+            std::copy(cell.samples + offset, cell.samples + offset + numToMix, cellSamples);
+            auto const cellEnergy = cell.energy;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            auto const after = cell.position.load(std::memory_order_relaxed);
+
+            if (before == cellStart && after == cellStart)
+            {
+                juce::FloatVectorOperations::add(left + index, cellSamples, numToMix);
+                if (right != nullptr) { juce::FloatVectorOperations::add(right + index, cellSamples, numToMix); }
+                energy += static_cast<double>(cellEnergy) * numToMix;
+            }
+            else if (active && offset == 0)
+            {
+                numMissingCells.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            position += static_cast<uint64_t>(numToMix);
+        }
+    }
+
+    playPosition = end;
+    readPosition.store(playPosition, std::memory_order_release);
+
+    return static_cast<float>(energy / numSamples);
+}
+
+//==============================================================================
+void HeadlessDriver::start(juce::AudioSource& sourceToDrive, double newSampleRate, int newBlockSize)
+{
+    stop();
+
+    source     = &sourceToDrive;
+    sampleRate = newSampleRate;
+    blockSize  = newBlockSize;
+    buffer.setSize(2, blockSize);
+
+    stopRequested.store(false);
+    driverThread = std::thread([this] { run(); });
+}
+
+void HeadlessDriver::stop()
+{
+    if (!driverThread.joinable()) { return; }
+
+    stopRequested.store(true);
+    driverThread.join();
+}
+
+void HeadlessDriver::run()
+{
+    using Clock = std::chrono::system_clock;
+
+    DBG("Rendering headless, " << blockSize << " samples at " << sampleRate << " Hz");
+
+    source->prepareToPlay(blockSize, sampleRate);
+
+    auto const blockDuration = std::chrono::duration<double>(blockSize / sampleRate);
+    auto const maxLag        = std::chrono::duration<double>(0.1);
+    auto start               = Clock::now();
+    uint64_t numBlocks       = 0;
+
+    while (!stopRequested.load())
+    {
+        source->getNextAudioBlock(juce::AudioSourceChannelInfo(buffer));
+
+        // Timed from the start rather than from the last block, so rounding never adds up
+        auto const due = start + std::chrono::duration_cast<Clock::duration>(blockDuration * ++numBlocks);
+        auto const lag = Clock::now() - due;
+
+        // Stalled, or the wall clock was stepped
+        if (lag > maxLag || lag < -maxLag)
+        {
+            if (lag > maxLag)
+            { numSkippedBlocks.fetch_add(static_cast<uint64_t>(lag / blockDuration), std::memory_order_relaxed); }
+
+            start     = Clock::now();
+            numBlocks = 0;
+            continue;
+        }
+
+        std::this_thread::sleep_until(due);
+    }
+
+    source->releaseResources();
+}
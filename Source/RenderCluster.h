@@ -0,0 +1,323 @@
+#pragma once
+
+#include "SpikeDecoder.h"
+#include "SpikeProtocol.h"
+#include "SpikeSource.h"
+#include "StreamStats.h"
+#include "ThreadTuning.h"
+#include "readerwriterqueue.h"
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <thread>
+
+//==============================================================================
+/*
+    Rendering spread over several processes, on one machine or many. Every
+    render node renders one shard, a range of neuron indices, with the usual
+    synth and sends the result to a mixer node instead of playing it. The
+    mixer sums the shards it receives, sample aligned, adds whatever it renders
+    itself and plays the mix through its OutputStage.
+
+    All nodes get the same spikes, usually from the simulator sending to each
+    of them; a node simply ignores the neurons outside its shard. Blocks are
+    placed on a common timeline by the wall clock, see AudioBlockHeader, so
+    the clocks of the machines have to be synchronised (NTP or better); on
+    loopback they are the same clock.
+
+    Configured on the command line:
+
+        --shard=0-10000        render only neurons [0, 10000)
+        --mix-to=host:6001     send the shard to a mixer instead of playing it
+        --mix-format=rtp       send the finished output as RTP instead, see ShardSender
+        --mix-port=6001        mix the shards arriving on this port into the output
+        --jitter-ms=40         how far behind the wall clock the mixer plays
+        --spike-ports=5002     the UDP spike port list to start with
+        --headless             no window and no sound card, see HeadlessDriver
+        --headless-rate=48000  the sample rate of a headless node
+        --headless-block=64    the block size of a headless node
+
+    A mixer without --shard renders no neurons of its own. For example, on
+    loopback:
+
+        OSC Web --mix-port=6001
+        OSC Web --shard=0-10000 --mix-to=127.0.0.1:6001 --spike-ports=5002
+        OSC Web --shard=10000-20000 --mix-to=127.0.0.1:6001 --spike-ports=5003
+*/
+struct ClusterSettings
+{
+    static constexpr int defaultJitterMs          = 40;
+    static constexpr double defaultHeadlessRate   = 48000.0;
+    static constexpr int defaultHeadlessBlockSize = 64;
+
+    static ClusterSettings parseCommandLine(juce::String const& commandLine);
+
+    bool isSharded() const { return shardFirst > 0 || shardEnd < std::numeric_limits<int>::max(); }
+    juce::String getDescription() const;
+
+    int shardFirst {0};
+    int shardEnd {std::numeric_limits<int>::max()};
+    juce::String mixerHost;
+    int mixerPort {};
+    int mixPort {};
+    bool rtp {};
+    int jitterMs {defaultJitterMs};
+    juce::String spikePorts;
+    bool headless {};
+    double headlessRate {defaultHeadlessRate};
+    int headlessBlockSize {defaultHeadlessBlockSize};
+};
+
+// Blocks travel and are buffered in cells of this many samples, at positions that are multiples of it
+static constexpr int clusterCellSize = 64;
+
+//==============================================================================
+/*
+    Passes on the spikes of one shard, renumbered so that the shard's first
+    neuron is voice 0.
+*/
+class ShardSpikeSource : public SpikeSource
+{
+public:
+    // Call before every render, numNeurons is the size of the whole network
+    void setSource(SpikeSource& newSource, int numNeurons, int newFirst, int newEnd)
+    {
+        source          = &newSource;
+        numTotalNeurons = numNeurons;
+        first           = newFirst;
+        end             = newEnd;
+    }
+
+    int pullSpikes(int numSamples, int numNeurons, int* dest, int maxSpikes) override
+    {
+        return pullWeightedSpikes(numSamples, numNeurons, dest, nullptr, maxSpikes);
+    }
+
+    int pullWeightedSpikes(int numSamples, int numNeurons, int* dest, float* weights, int maxSpikes) override;
+
+private:
+    SpikeSource* source {};
+    int numTotalNeurons {};
+    int first {};
+    int end {};
+};
+
+//==============================================================================
+/*
+    The sending end of a render node. push() is called on the audio thread
+    with every rendered block; it cuts the blocks into cells and queues them
+    on a wait-free ring, and a sender thread packs the queued cells into
+    packets in a buffer on its stack, so nothing is allocated once started.
+
+    Format::cells sends audio packets with the envelope energy for a
+    ShardMixer. Format::rtp sends RTP packets of 16 bit big endian mono PCM
+    (L16, dynamic payload type rtpPayloadType) whose timestamps are the low
+    32 bits of the position, for mixers that are not ours; those get the
+    finished output, after the node's own OutputStage.
+
+    The first block is placed at the wall clock time it is rendered at, the
+    following ones right after it. If the audio clock drifts more than
+    driftToleranceSeconds away from the wall clock, the stream is placed anew,
+    which the mixer hears as a short gap or a skip.
+*/
+class ShardSender
+{
+public:
+    static constexpr int numQueuedCells           = 1024;
+    static constexpr double driftToleranceSeconds = 0.02;
+    static constexpr uint8_t rtpPayloadType       = 96;
+    static constexpr size_t rtpHeaderSize         = 12;
+
+    enum class Format
+    {
+        cells,
+        rtp
+    };
+
+    explicit ShardSender(ThreadTuning& threadTuning);
+    ~ShardSender();
+
+    juce::Result start(juce::String const& host, int port, int shard, Format format);
+    void stop();
+    bool isRunning() const { return running.load(std::memory_order_relaxed); }
+    Format getFormat() const { return format; }
+
+    void prepare(double sampleRate);
+
+    // Realtime safe, energy is the block's NeuronSynth::getEnvelopeEnergy()
+    void push(float const* samples, int numSamples, float energy);
+
+    uint64_t getNumPacketsSent() const { return numPacketsSent.load(std::memory_order_relaxed); }
+    uint64_t getNumCellsDropped() const { return numCellsDropped.load(std::memory_order_relaxed); }
+    uint64_t getNumResyncs() const { return numResyncs.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell
+    {
+        uint64_t position;
+        float energy;
+        float samples[clusterCellSize];
+    };
+
+    void run();
+    void send(Cell const* cells, int numCells);
+    size_t writeCellPacket(uint8_t* dest, Cell const* cells, int numCells);
+    size_t writeRtpPacket(uint8_t* dest, Cell const* cells, int numCells);
+
+    ThreadTuning& threadTuning;
+
+    moodycamel::ReaderWriterQueue<Cell> queue {numQueuedCells};
+    Cell pending {};
+    int pendingSize {};
+    bool anchored {};
+
+    std::atomic<double> sampleRate {44100.0};
+    std::atomic<bool> running {false};
+    std::atomic<bool> stopRequested {false};
+    std::thread senderThread;
+    std::unique_ptr<juce::DatagramSocket> udp;
+    juce::String host;
+    int port {};
+    uint16_t shard {};
+    Format format {Format::cells};
+    uint32_t sequence {};
+
+    std::atomic<uint64_t> numPacketsSent {0};
+    std::atomic<uint64_t> numCellsDropped {0};
+    std::atomic<uint64_t> numResyncs {0};
+};
+
+//==============================================================================
+/*
+    The receiving end, on the mixer node. Every shard gets a jitter buffer of
+    numCells cells, indexed by the position of the cell, which the receive
+    thread writes and the audio thread reads. A cell carries the position it
+    holds and is written like a seqlock: the position is cleared, the samples
+    written, then the position set. The audio thread only mixes a cell whose
+    position was the expected one before and after it copied the samples, so
+    it never waits and never mixes a torn cell.
+
+    The audio thread plays jitterMs behind the wall clock. Cells that arrive
+    after their time has been played are late and dropped; cells that have
+    not arrived by then are missing and play as silence. Shards are told apart
+    by the shard field, the first neuron they render, and a shard that has not
+    sent anything for a second gives up its buffer.
+*/
+class ShardMixer
+{
+public:
+    static constexpr int maxNumShards = 16;
+    static constexpr int numCells     = 256;
+
+    explicit ShardMixer(ThreadTuning& threadTuning);
+    ~ShardMixer();
+
+    juce::Result start(int port);
+    void stop();
+    bool isRunning() const { return running.load(std::memory_order_relaxed); }
+
+    void prepare(double sampleRate, int jitterMs);
+
+    // Realtime safe. Adds the shards' next numSamples samples to left and
+    // right (which may be nullptr) and returns their envelope energy.
+    float mix(float* left, float* right, int numSamples);
+
+    int getNumActiveShards() const;
+    uint64_t getNumPacketsReceived() const { return numPacketsReceived.load(std::memory_order_relaxed); }
+    uint64_t getNumLatePackets() const { return numLatePackets.load(std::memory_order_relaxed); }
+    uint64_t getNumMissingCells() const { return numMissingCells.load(std::memory_order_relaxed); }
+    uint64_t getNumRejectedPackets() const { return numRejectedPackets.load(std::memory_order_relaxed); }
+    uint64_t getNumResyncs() const { return numResyncs.load(std::memory_order_relaxed); }
+    void addStreamStats(StreamStats& stats) const { streamCounters.addTo(stats); }
+
+    // Called back by SpikeDecoder::decode() on the receive thread
+    void onPacket(PacketHeader const& header);
+    void onAudio(PacketHeader const& header, AudioBlockHeader const& block, SpikeDecoder::ByteView samples);
+
+    // Spikes and initialisations belong on the spike ports
+    void onPerformance(uint32_t, uint8_t) { }
+    void onInitialisation(uint16_t, uint16_t) { }
+    void onInitialisationContent(SpikeDecoder::ByteView) { }
+    void onHello(PacketHeader const&, Capabilities const&) { }
+
+private:
+    static constexpr uint64_t noPosition = std::numeric_limits<uint64_t>::max();
+
+    struct Cell
+    {
+        std::atomic<uint64_t> position {noPosition};
+        float energy {};
+        float samples[clusterCellSize] {};
+    };
+
+    struct Shard
+    {
+        std::atomic<int> id {-1};
+        std::atomic<uint64_t> firstPosition {0};
+        std::atomic<uint64_t> lastPosition {0};
+        std::array<Cell, numCells> cells;
+    };
+
+    void run();
+    Shard* findShard(int id, uint64_t position);
+    bool isActive(Shard const& shard, uint64_t position) const;
+
+    ThreadTuning& threadTuning;
+
+    std::array<std::unique_ptr<Shard>, maxNumShards> shards;
+
+    std::atomic<double> sampleRate {44100.0};
+    uint64_t jitterFrames {};
+    uint64_t playPosition {};
+    std::atomic<uint64_t> readPosition {0};
+
+    std::atomic<bool> running {false};
+    std::atomic<bool> stopRequested {false};
+    std::thread receiverThread;
+    std::unique_ptr<juce::DatagramSocket> udp;
+    int port {};
+
+    SequenceTracker sequenceTracker;
+    StreamCounters streamCounters;
+
+    std::atomic<uint64_t> numPacketsReceived {0};
+    std::atomic<uint64_t> numLatePackets {0};
+    std::atomic<uint64_t> numMissingCells {0};
+    std::atomic<uint64_t> numRejectedPackets {0};
+    std::atomic<uint64_t> numResyncs {0};
+};
+
+//==============================================================================
+/*
+    Clocks the rendering of a node without a sound card. A thread of its own
+    calls the source in blocks of blockSize samples into a buffer allocated
+    once, at the pace of the wall clock rather than a device; that is the
+    clock the cluster's timeline runs on, so the node never drifts from it.
+    After a stall it skips ahead instead of rendering the missed blocks in a
+    burst.
+*/
+class HeadlessDriver
+{
+public:
+    ~HeadlessDriver() { stop(); }
+
+    void start(juce::AudioSource& source, double sampleRate, int blockSize);
+    void stop();
+
+    uint64_t getNumSkippedBlocks() const { return numSkippedBlocks.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+
+    juce::AudioSource* source {};
+    juce::AudioBuffer<float> buffer;
+    double sampleRate {ClusterSettings::defaultHeadlessRate};
+    int blockSize {ClusterSettings::defaultHeadlessBlockSize};
+
+    std::thread driverThread;
+    std::atomic<bool> stopRequested {false};
+    std::atomic<uint64_t> numSkippedBlocks {0};
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include "SpikeProtocol.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+//==============================================================================
+/*
+    Bounded spike ring in POSIX shared memory, for simulators running on the
+    same machine. The engine creates it under a name such as "/oscweb-spikes",
+    any number of other processes attach to it and push spikes, and the audio
+    thread pops them directly: no socket, no syscall and no receiver thread in
+    between.
+
+    Every slot holds a PerformanceMessage plus a sequence number (Vyukov's
+    bounded queue), which makes push() safe from several producer threads or
+    processes at once. There is exactly one consumer. When the ring is full,
+    push() drops the spike and counts it instead of waiting.
+
+    This header only depends on the standard library and POSIX, so simulators
+    can include it (together with SpikeProtocol.h) as is.
+*/
+class SharedSpikeRing
+{
+public:
+    static constexpr uint32_t magic   = 0x4f57534d;  // "OWSM"
+    static constexpr uint32_t version = 1;
+
+    SharedSpikeRing() = default;
+    ~SharedSpikeRing() { close(); }
+
+    SharedSpikeRing(SharedSpikeRing const&) = delete;
+    SharedSpikeRing& operator=(SharedSpikeRing const&) = delete;
+
+    // Creates (or recreates) the ring as its consumer. capacity is rounded up to a power of two.
+    bool create(std::string const& ringName, uint32_t capacity)
+    {
+        close();
+
+        uint32_t roundedCapacity = 1;
+        while (roundedCapacity < capacity) { roundedCapacity <<= 1; }
+
+        if (!map(ringName, roundedCapacity, true)) { return false; }
+
+        header->capacity = roundedCapacity;
+        header->writeIndex.store(0);
+        header->readIndex.store(0);
+        header->numDropped.store(0);
+
+        for (uint32_t i = 0; i < roundedCapacity; i++) { slots[i].sequence.store(i, std::memory_order_relaxed); }
+
+        header->version = version;
+        header->magic   = magic;
+        std::atomic_thread_fence(std::memory_order_release);
+        return true;
+    }
+
+    // Attaches to a ring created by another process, as a producer
+    bool attach(std::string const& ringName) { return map(ringName, 0, false); }
+
+    void close()
+    {
+#if !defined(_WIN32)
+        if (header != nullptr) { munmap(header, mappedSize); }
+        if (isOwner) { shm_unlink(name.c_str()); }
+#endif
+        header     = nullptr;
+        slots      = nullptr;
+        mappedSize = 0;
+        isOwner    = false;
+    }
+
+    bool isOpen() const { return header != nullptr; }
+    std::string const& getName() const { return name; }
+    std::string const& getLastError() const { return lastError; }
+
+    // Safe to call from any number of producers
+    bool push(uint16_t index)
+    {
+        auto const mask = header->capacity - 1;
+        auto position   = header->writeIndex.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            auto& slot      = slots[position & mask];
+            auto const diff = static_cast<int32_t>(slot.sequence.load(std::memory_order_acquire) - position);
+
+            if (diff == 0)
+            {
+                if (header->writeIndex.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    slot.message.type  = MessageType::Performance;
+                    slot.message.index = index;
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                header->numDropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                position = header->writeIndex.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Single consumer only. Pops up to maxSpikes indices, skipping those not below numNeurons.
+    int pop(int* dest, int maxSpikes, int numNeurons)
+    {
+        auto const mask     = header->capacity - 1;
+        auto const capacity = header->capacity;
+        auto position       = header->readIndex.load(std::memory_order_relaxed);
+        int numSpikes       = 0;
+
+        while (numSpikes < maxSpikes)
+        {
+            auto& slot = slots[position & mask];
+            if (slot.sequence.load(std::memory_order_acquire) != position + 1) { break; }
+
+            auto const message = slot.message;
+            slot.sequence.store(position + capacity, std::memory_order_release);
+            position++;
+
+            if (message.type == MessageType::Performance && message.index < numNeurons)
+            { dest[numSpikes++] = message.index; }
+        }
+
+        header->readIndex.store(position, std::memory_order_relaxed);
+        return numSpikes;
+    }
+
+    uint64_t getNumDropped() const { return header != nullptr ? header->numDropped.load() : 0; }
+
+private:
+    struct alignas(64) Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t capacity;
+        uint32_t slotSize;
+        alignas(64) std::atomic<uint32_t> writeIndex;
+        alignas(64) std::atomic<uint32_t> readIndex;
+        alignas(64) std::atomic<uint64_t> numDropped;
+    };
+
+    struct Slot
+    {
+        std::atomic<uint32_t> sequence;
+        PerformanceMessage message;
+    };
+
+    static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+                  "The ring lives in memory shared between processes, its atomics must be lock free");
+    static_assert(sizeof(Slot) == 8, "");
+
+    bool fail(std::string const& what)
+    {
+        lastError = what + " '" + name + "': " + std::strerror(errno);
+        close();
+        return false;
+    }
+
+    bool map(std::string const& ringName, uint32_t capacity, bool shouldCreate)
+    {
+        name = ringName;
+
+#if defined(_WIN32)
+        lastError = "Shared memory spike rings are only available on POSIX systems";
+        return false;
+#else
+        int const flags = shouldCreate ? O_CREAT | O_RDWR : O_RDWR;
+        int const fd    = shm_open(name.c_str(), flags, 0666);
+        if (fd < 0) { return fail("Could not open shared memory"); }
+
+        if (shouldCreate)
+        {
+            mappedSize = sizeof(Header) + sizeof(Slot) * capacity;
+
+            if (ftruncate(fd, static_cast<off_t>(mappedSize)) != 0)
+            {
+                ::close(fd);
+                return fail("Could not size shared memory");
+            }
+        }
+        else
+        {
+            struct stat info {};
+            fstat(fd, &info);
+            mappedSize = static_cast<size_t>(info.st_size);
+        }
+
+        auto const address = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (address == MAP_FAILED || mappedSize < sizeof(Header))
+        {
+            if (address != MAP_FAILED) { munmap(address, mappedSize); }
+            return fail("Could not map shared memory");
+        }
+
+        header  = static_cast<Header*>(address);
+        slots   = reinterpret_cast<Slot*>(static_cast<uint8_t*>(address) + sizeof(Header));
+        isOwner = shouldCreate;
+
+        if (!shouldCreate)
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            auto const expectedSize = sizeof(Header) + sizeof(Slot) * static_cast<size_t>(header->capacity);
+
+            if (header->magic != magic || header->version != version || mappedSize < expectedSize)
+            {
+                errno = EPROTO;
+                return fail("Not a compatible spike ring");
+            }
+        }
+
+        return true;
+#endif
+    }
+
+    Header* header {};
+    Slot* slots {};
+    size_t mappedSize {};
+    bool isOwner {};
+    std::string name;
+    std::string lastError;
+};
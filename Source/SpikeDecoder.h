@@ -0,0 +1,297 @@
+#pragma once
+
+#include "SpikeProtocol.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//==============================================================================
+/*
+    Bounds checked decoder for the UDP spike datagrams, working in place on
+    the received bytes like OscDecoder does for OSC. Both the legacy datagrams
+    and the versioned packets described in SpikeProtocol.h are understood.
+
+    Every message type has one row in a table giving its smallest valid size,
+    the unit in which more bytes may follow and the function that hands it to
+    the handler. A datagram is checked against its row once; after that the
+    payload is only ever read through a ByteView, which cannot read past the
+    end of the datagram. Multi-byte fields are little endian on the wire and
+    are assembled byte by byte, so the host byte order does not matter.
+
+    decode() calls one of
+
+        handler.onPerformance(uint32_t index, uint8_t weight), once per spike
+        handler.onInitialisation(uint16_t numFrequencies, uint16_t chunkSize)
+        handler.onInitialisationContent(SpikeDecoder::ByteView frequencies)
+        handler.onHello(PacketHeader const& header, Capabilities const& sender)
+        handler.onAudio(PacketHeader const& header, AudioBlockHeader const& block, SpikeDecoder::ByteView samples)
+
+    A versioned packet is only dispatched once its header, version, flags and
+    payload size have all been checked; handler.onPacket(PacketHeader const&)
+    is called for it first, so sequence numbers and send times can be tracked
+    in one place. Packets from a newer protocol version or with flags this
+    build does not know are rejected as unsupported.
+
+    and returns what, if anything, was wrong with the datagram. Nothing is
+    copied and nothing asserts, broken senders are the caller's to count.
+*/
+namespace SpikeDecoder
+{
+enum class Error
+{
+    none,
+    empty,
+    unknownType,
+    truncated,
+    badLength,
+    unsupported,
+};
+
+//==============================================================================
+// A read-only view of a run of bytes, std::span for the little we need
+class ByteView
+{
+public:
+    ByteView() = default;
+    ByteView(uint8_t const* data, size_t size)
+        : bytes(data)
+        , numBytes(size)
+    {
+    }
+
+    size_t size() const { return numBytes; }
+    bool has(size_t offset, size_t length) const { return offset <= numBytes && length <= numBytes - offset; }
+
+    ByteView from(size_t offset) const
+    {
+        return offset <= numBytes ? ByteView(bytes + offset, numBytes - offset) : ByteView();
+    }
+
+    // Out of range reads give 0, callers check has() first where that matters
+    uint8_t readUint8(size_t offset) const { return has(offset, 1) ? bytes[offset] : 0; }
+
+    uint16_t readUint16(size_t offset) const
+    {
+        if (!has(offset, 2)) { return 0; }
+        return static_cast<uint16_t>(bytes[offset] | (bytes[offset + 1] << 8));
+    }
+
+    uint32_t readUint32(size_t offset) const
+    {
+        if (!has(offset, 4)) { return 0; }
+
+        return static_cast<uint32_t>(bytes[offset]) | (static_cast<uint32_t>(bytes[offset + 1]) << 8)
+               | (static_cast<uint32_t>(bytes[offset + 2]) << 16) | (static_cast<uint32_t>(bytes[offset + 3]) << 24);
+    }
+
+    uint64_t readUint64(size_t offset) const
+    {
+        if (!has(offset, 8)) { return 0; }
+        return static_cast<uint64_t>(readUint32(offset)) | (static_cast<uint64_t>(readUint32(offset + 4)) << 32);
+    }
+
+    float readFloat(size_t offset) const
+    {
+        auto const bits = readUint32(offset);
+        float value     = 0.f;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+private:
+    uint8_t const* bytes {};
+    size_t numBytes {};
+};
+
+//==============================================================================
+template <typename Handler>
+Error decodePerformance(ByteView payload, Handler& handler)
+{
+    handler.onPerformance(payload.readUint16(0), spikeWeightUnit);
+    return Error::none;
+}
+
+template <typename Handler>
+Error decodeInitialisation(ByteView payload, Handler& handler)
+{
+    handler.onInitialisation(payload.readUint16(0), payload.readUint16(2));
+    return Error::none;
+}
+
+template <typename Handler>
+Error decodeInitialisationContent(ByteView payload, Handler& handler)
+{
+    handler.onInitialisationContent(payload);
+    return Error::none;
+}
+
+//==============================================================================
+template <typename Handler>
+Error decodeSpikePacket(PacketHeader const& header, ByteView payload, Handler& handler)
+{
+    auto const wide      = (header.flags & PacketFlags::wideIndices) != 0;
+    auto const weighted  = (header.flags & PacketFlags::weighted) != 0;
+    auto const indexSize = wide ? size_t {4} : size_t {2};
+    auto const width     = indexSize + (weighted ? 1 : 0);
+
+    // Receivers advertise maxPacketBatch in their capabilities and size their buffers by it
+    if (header.count > maxPacketBatch || payload.size() != header.count * width) { return Error::badLength; }
+
+    for (size_t i = 0, offset = 0; i < header.count; i++, offset += width)
+    {
+        auto const index  = wide ? payload.readUint32(offset) : payload.readUint16(offset);
+        auto const weight = weighted ? payload.readUint8(offset + indexSize) : spikeWeightUnit;
+        handler.onPerformance(index, weight);
+    }
+
+    return Error::none;
+}
+
+template <typename Handler>
+Error decodeInitialisationPacket(PacketHeader const&, ByteView payload, Handler& handler)
+{
+    return decodeInitialisation(payload, handler);
+}
+
+template <typename Handler>
+Error decodeInitialisationContentPacket(PacketHeader const&, ByteView payload, Handler& handler)
+{
+    return decodeInitialisationContent(payload, handler);
+}
+
+inline Capabilities readCapabilities(ByteView payload)
+{
+    return {payload.readUint8(0), payload.readUint8(1), payload.readUint8(2), payload.readUint16(4),
+            payload.readUint8(3)};
+}
+
+template <typename Handler>
+Error decodeHello(PacketHeader const& header, ByteView payload, Handler& handler)
+{
+    handler.onHello(header, readCapabilities(payload));
+    return Error::none;
+}
+
+template <typename Handler>
+Error decodeAudioPacket(PacketHeader const& header, ByteView payload, Handler& handler)
+{
+    if (header.count > maxAudioFrames || payload.size() != audioHeaderSize + header.count * size_t {4})
+    { return Error::badLength; }
+
+    auto const block = AudioBlockHeader {payload.readUint64(0), payload.readUint32(8), payload.readUint16(12),
+                                         payload.readFloat(16)};
+
+    handler.onAudio(header, block, payload.from(audioHeaderSize));
+    return Error::none;
+}
+
+// Only a receiver answers with capabilities, one arriving here is ignored
+template <typename Handler>
+Error ignorePacket(PacketHeader const&, ByteView, Handler&)
+{
+    return Error::none;
+}
+
+inline bool isPacket(uint8_t const* data, size_t size)
+{
+    return size >= 2 && data[0] == packetMagic[0] && data[1] == packetMagic[1];
+}
+
+template <typename Handler>
+Error decodePacket(ByteView packet, Handler& handler)
+{
+    struct Row
+    {
+        size_t minPayloadSize;
+        size_t elementSize;
+        Error (*decode)(PacketHeader const&, ByteView, Handler&);
+    };
+
+    // Indexed by PacketType. Hello and capabilities may grow at the end in
+    // later versions, so their tail is accepted and ignored. The element size
+    // of spikes depends on the flags, decodeSpikePacket() checks it exactly.
+    static constexpr Row table[] = {
+        {0, 1, &decodeSpikePacket<Handler>},
+        {4, 1, &decodeInitialisationPacket<Handler>},
+        {0, 4, &decodeInitialisationContentPacket<Handler>},
+        {capabilitiesSize, 1, &decodeHello<Handler>},
+        {capabilitiesSize, 1, &ignorePacket<Handler>},
+        {audioHeaderSize, 4, &decodeAudioPacket<Handler>},
+    };
+
+    static_assert(sizeof(table) / sizeof(table[0]) == static_cast<size_t>(PacketType::numTypes), "");
+
+    if (packet.size() < packetHeaderSize) { return Error::truncated; }
+
+    PacketHeader header {};
+    header.version  = packet.readUint8(2);
+    header.flags    = packet.readUint8(3);
+    header.count    = packet.readUint16(6);
+    header.sequence = packet.readUint32(8);
+
+    if (header.version == 0 || header.version > protocolVersion) { return Error::unsupported; }
+    if ((header.flags & ~PacketFlags::all) != 0) { return Error::unsupported; }
+
+    auto const type = static_cast<size_t>(packet.readUint8(4));
+    if (type >= sizeof(table) / sizeof(table[0])) { return Error::unknownType; }
+
+    header.type     = static_cast<PacketType>(type);
+    auto headerSize = packetHeaderSize;
+
+    if ((header.flags & PacketFlags::timestamped) != 0)
+    {
+        if (!packet.has(headerSize, packetTimeSize)) { return Error::truncated; }
+
+        header.sendTimeNanos = packet.readUint64(headerSize);
+        headerSize += packetTimeSize;
+    }
+
+    auto const& row     = table[type];
+    auto const payload  = packet.from(headerSize);
+    auto const overhang = payload.size() - row.minPayloadSize;
+
+    if (payload.size() < row.minPayloadSize) { return Error::truncated; }
+    if (overhang % row.elementSize != 0) { return Error::badLength; }
+
+    handler.onPacket(header);
+    return row.decode(header, payload, handler);
+}
+
+//==============================================================================
+template <typename Handler>
+Error decode(uint8_t const* data, size_t size, Handler& handler)
+{
+    struct Row
+    {
+        size_t minPayloadSize;
+        size_t elementSize;  // anything after minPayloadSize comes in whole elements of this size
+        Error (*decode)(ByteView, Handler&);
+    };
+
+    // Indexed by MessageType. Senders that pad the fixed size messages are
+    // accepted, the padding is never read.
+    static constexpr Row table[] = {
+        {2, 1, &decodePerformance<Handler>},
+        {4, 1, &decodeInitialisation<Handler>},
+        {0, 4, &decodeInitialisationContent<Handler>},
+    };
+
+    static_assert(sizeof(table) / sizeof(table[0]) == static_cast<size_t>(MessageType::Unknown), "");
+
+    if (size == 0) { return Error::empty; }
+    if (isPacket(data, size)) { return decodePacket(ByteView(data, size), handler); }
+
+    auto const type = static_cast<size_t>(data[0]);
+    if (type >= sizeof(table) / sizeof(table[0])) { return Error::unknownType; }
+
+    auto const& row     = table[type];
+    auto const payload  = ByteView(data + 1, size - 1);
+    auto const overhang = payload.size() - row.minPayloadSize;
+
+    if (payload.size() < row.minPayloadSize) { return Error::truncated; }
+    if (overhang % row.elementSize != 0) { return Error::badLength; }
+
+    return row.decode(payload, handler);
+}
+}  // namespace SpikeDecoder
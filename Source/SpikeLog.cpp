@@ -0,0 +1,251 @@
+#include "SpikeLog.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+int64_t nowMicros()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+int writeVarint(uint8_t* dest, uint64_t value)
+{
+    int numBytes = 0;
+
+    while (value >= 0x80)
+    {
+        dest[numBytes++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+
+    dest[numBytes++] = static_cast<uint8_t>(value);
+    return numBytes;
+}
+
+// Returns false if the data ends before the varint does
+bool readVarint(uint8_t const* data, size_t size, size_t& position, uint64_t& value)
+{
+    value     = 0;
+    int shift = 0;
+
+    while (position < size && shift < 64)
+    {
+        auto const byte = data[position++];
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0) { return true; }
+        shift += 7;
+    }
+
+    return false;
+}
+}  // namespace
+
+//==============================================================================
+SpikeRecorder::SpikeRecorder(ThreadTuning& tuning)
+    : threadTuning(tuning)
+{
+    for (auto& queue : events) { queue = std::make_unique<moodycamel::ReaderWriterQueue<Event>>(1 << 14); }
+
+    pendingEvents.reserve(maxNumProducers << 14);
+}
+
+SpikeRecorder::~SpikeRecorder() { stop(); }
+
+juce::Result SpikeRecorder::start(juce::File const& file)
+{
+    stop();
+
+    file.getParentDirectory().createDirectory();
+    stream = std::make_unique<juce::FileOutputStream>(file);
+
+    if (stream->failedToOpen()) { return stream->getStatus(); }
+
+    stream->setPosition(0);
+    stream->truncate();
+
+    uint8_t header[SpikeLogFormat::headerSize] = {};
+    std::memcpy(header, SpikeLogFormat::magic, sizeof(SpikeLogFormat::magic));
+    for (int i = 0; i < 4; i++) { header[8 + i] = static_cast<uint8_t>(SpikeLogFormat::version >> (8 * i)); }
+    stream->write(header, sizeof(header));
+
+    // Drop whatever an earlier recording left behind
+    Event stale {};
+    for (auto& queue : events)
+    {
+        while (queue->try_dequeue(stale)) { }
+    }
+
+    encodeBuffer.resize(4096);
+    startMicros = nowMicros();
+    lastMicros  = startMicros;
+    numSpikesRecorded.store(0);
+    numSpikesDropped.store(0);
+
+    recording.store(true);
+    writerThread = std::thread([this] { writeLoop(); });
+
+    return juce::Result::ok();
+}
+
+void SpikeRecorder::stop()
+{
+    recording.store(false);
+
+    if (writerThread.joinable()) { writerThread.join(); }
+
+    stream.reset();
+}
+
+void SpikeRecorder::record(int index, int producer)
+{
+    if (!recording.load(std::memory_order_relaxed)) { return; }
+
+    jassert(producer >= 0 && producer < maxNumProducers);
+
+    if (events[producer]->try_enqueue({nowMicros(), static_cast<uint32_t>(index)}))
+    { numSpikesRecorded.fetch_add(1, std::memory_order_relaxed); }
+    else
+    {
+        numSpikesDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SpikeRecorder::writeLoop()
+{
+    threadTuning.applyToCurrentThread(ThreadTuning::Role::worker, 1);
+
+    while (recording.load())
+    {
+        writePendingEvents();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    writePendingEvents();
+    stream->flush();
+}
+
+void SpikeRecorder::writePendingEvents()
+{
+    auto const flushThreshold = encodeBuffer.size() - 2 * SpikeLogFormat::maxVarintSize;
+    size_t numBytes           = 0;
+    Event dequeued {};
+
+    // Interleave the producers by time. Spikes stamped just before the previous
+    // batch was written can still show up late, they get a delta of 0.
+    pendingEvents.clear();
+    for (auto& queue : events)
+    {
+        while (queue->try_dequeue(dequeued)) { pendingEvents.push_back(dequeued); }
+    }
+
+    std::stable_sort(pendingEvents.begin(), pendingEvents.end(),
+                     [](Event const& a, Event const& b) { return a.micros < b.micros; });
+
+    for (auto const& event : pendingEvents)
+    {
+        auto const delta = event.micros > lastMicros ? event.micros - lastMicros : 0;
+        lastMicros += delta;
+
+        numBytes += writeVarint(encodeBuffer.data() + numBytes, static_cast<uint64_t>(delta));
+        numBytes += writeVarint(encodeBuffer.data() + numBytes, event.index);
+
+        if (numBytes >= flushThreshold)
+        {
+            stream->write(encodeBuffer.data(), numBytes);
+            numBytes = 0;
+        }
+    }
+
+    if (numBytes > 0) { stream->write(encodeBuffer.data(), numBytes); }
+}
+
+//==============================================================================
+juce::Result SpikeReplay::load(juce::File const& fileToLoad)
+{
+    auto mapped = std::make_unique<juce::MemoryMappedFile>(fileToLoad, juce::MemoryMappedFile::readOnly);
+    auto bytes  = static_cast<uint8_t const*>(mapped->getData());
+
+    if (bytes == nullptr || mapped->getSize() < static_cast<size_t>(SpikeLogFormat::headerSize)
+        || std::memcmp(bytes, SpikeLogFormat::magic, sizeof(SpikeLogFormat::magic)) != 0)
+    { return juce::Result::fail("Not a spike log: " + fileToLoad.getFullPathName()); }
+
+    uint32_t fileVersion = 0;
+    for (int i = 0; i < 4; i++) { fileVersion |= static_cast<uint32_t>(bytes[8 + i]) << (8 * i); }
+
+    if (fileVersion != SpikeLogFormat::version)
+    { return juce::Result::fail("Unsupported spike log version " + juce::String(fileVersion)); }
+
+    const juce::SpinLock::ScopedLockType lock(fileLock);
+
+    file     = std::move(mapped);
+    data     = bytes + SpikeLogFormat::headerSize;
+    dataSize = file->getSize() - SpikeLogFormat::headerSize;
+    restart();
+
+    return juce::Result::ok();
+}
+
+void SpikeReplay::prepare(double newSampleRate, int) { sampleRate = newSampleRate; }
+
+int SpikeReplay::pullSpikes(int numSamples, int numNeurons, int* dest, int maxSpikes)
+{
+    const juce::SpinLock::ScopedTryLockType lock(fileLock);
+    if (!lock.isLocked() || data == nullptr) { return 0; }
+
+    if (rewindPending.exchange(false)) { restart(); }
+
+    playbackMicros += numSamples / sampleRate * 1.0e6 * speed.load();
+
+    int numSpikes = 0;
+
+    while (numSpikes < maxSpikes)
+    {
+        if (nextIndex < 0)
+        {
+            if (!looping.load()) { break; }
+
+            // Continue from the start, keeping whatever time is left of this block
+            auto const overshoot = playbackMicros - static_cast<double>(nextMicros);
+            restart();
+            playbackMicros = overshoot > 0.0 ? overshoot : 0.0;
+
+            // An empty log would loop forever
+            if (nextIndex < 0) { break; }
+        }
+
+        if (static_cast<double>(nextMicros) > playbackMicros) { break; }
+
+        if (nextIndex < numNeurons) { dest[numSpikes++] = nextIndex; }
+
+        if (!decodeNext()) { nextIndex = -1; }
+    }
+
+    return numSpikes;
+}
+
+bool SpikeReplay::decodeNext()
+{
+    uint64_t delta = 0;
+    uint64_t index = 0;
+
+    if (!readVarint(data, dataSize, readPosition, delta) || !readVarint(data, dataSize, readPosition, index))
+    { return false; }
+
+    nextMicros += static_cast<int64_t>(delta);
+    nextIndex = static_cast<int>(index);
+    return true;
+}
+
+void SpikeReplay::restart()
+{
+    readPosition   = 0;
+    playbackMicros = 0.0;
+    nextMicros     = 0;
+    nextIndex      = -1;
+
+    if (!decodeNext()) { nextIndex = -1; }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "SpikeSource.h"
+#include "ThreadTuning.h"
+#include "readerwriterqueue.h"
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+/*
+    Spike log file layout, all integers little endian:
+
+        8 bytes   magic "OWSPIKES"
+        4 bytes   format version
+        4 bytes   reserved, 0
+        records   LEB128 varint of the microseconds since the previous spike,
+                  followed by the LEB128 varint of the neuron index
+
+    Spikes are only ever appended, so a recording that was cut off still
+    replays up to its last complete record.
+*/
+namespace SpikeLogFormat
+{
+static constexpr char magic[8]               = {'O', 'W', 'S', 'P', 'I', 'K', 'E', 'S'};
+static constexpr uint32_t version            = 1;
+static constexpr int headerSize              = 16;
+static constexpr int maxVarintSize           = 10;
+static constexpr char const* fileExtension   = ".spikes";
+}  // namespace SpikeLogFormat
+
+//==============================================================================
+/*
+    Captures spikes to a spike log. record() is meant to be called on the
+    receiver threads: it only timestamps the spike and hands it to a background
+    writer thread through a lock free queue, the encoding and file IO happen
+    there. Every producer thread needs its own producer id.
+*/
+class SpikeRecorder
+{
+public:
+    static constexpr int maxNumProducers = 16;
+
+    explicit SpikeRecorder(ThreadTuning& threadTuning);
+    ~SpikeRecorder();
+
+    juce::Result start(juce::File const& file);
+    void stop();
+    bool isRecording() const { return recording.load(); }
+
+    void record(int index, int producer = 0);
+
+    uint64_t getNumSpikesRecorded() const { return numSpikesRecorded.load(std::memory_order_relaxed); }
+    uint64_t getNumSpikesDropped() const { return numSpikesDropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Event
+    {
+        int64_t micros;
+        uint32_t index;
+    };
+
+    void writeLoop();
+    void writePendingEvents();
+
+    ThreadTuning& threadTuning;
+
+    std::array<std::unique_ptr<moodycamel::ReaderWriterQueue<Event>>, maxNumProducers> events;
+    std::vector<Event> pendingEvents;
+
+    std::unique_ptr<juce::FileOutputStream> stream;
+    std::thread writerThread;
+    std::atomic<bool> recording {false};
+
+    int64_t startMicros {};
+    int64_t lastMicros {};
+    std::vector<uint8_t> encodeBuffer;
+
+    std::atomic<uint64_t> numSpikesRecorded {0};
+    std::atomic<uint64_t> numSpikesDropped {0};
+};
+
+//==============================================================================
+/*
+    Plays a spike log back as a spike source. The file is memory mapped and
+    decoded incrementally on the audio thread, advancing by the duration of
+    each rendered block multiplied by the playback speed.
+*/
+class SpikeReplay : public SpikeSource
+{
+public:
+    // Not realtime safe, call from the message thread
+    juce::Result load(juce::File const& file);
+
+    void prepare(double sampleRate, int maxBlockSize) override;
+    int pullSpikes(int numSamples, int numNeurons, int* dest, int maxSpikes) override;
+
+    void setSpeed(double newSpeed) { speed.store(newSpeed > 0.0 ? newSpeed : 1.0); }
+    void setLooping(bool shouldLoop) { looping.store(shouldLoop); }
+    void rewind() { rewindPending.store(true); }
+
+private:
+    bool decodeNext();
+    void restart();
+
+    juce::SpinLock fileLock;
+    std::unique_ptr<juce::MemoryMappedFile> file;
+    uint8_t const* data {};
+    size_t dataSize {};
+
+    size_t readPosition {};
+    double playbackMicros {};
+    int64_t nextMicros {};
+    int nextIndex {-1};
+
+    double sampleRate {44100.0};
+    std::atomic<double> speed {1.0};
+    std::atomic<bool> looping {true};
+    std::atomic<bool> rewindPending {false};
+};
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//==============================================================================
+/*
+    Datagrams understood by the UDP spike input. The first byte is always the
+    MessageType, the payload follows directly after it.
+*/
+enum class MessageType : uint8_t
+{
+    Performance,
+    Initialisation,
+    InitialisationContent,
+    Unknown,
+};
+struct PerformanceMessage
+{
+    MessageType type;
+    uint16_t index;
+};
+static_assert(sizeof(PerformanceMessage) == 4, "");
+
+struct InitialisationMessage
+{
+    MessageType type;
+    uint16_t numFrequencies;
+    uint16_t chunkSize;
+};
+
+struct InitialisationContentMessage
+{
+    MessageType type;
+    float frequency;
+};
+
+//==============================================================================
+/*
+    Versioned datagrams. They start with the magic bytes "OW", which can never
+    be mistaken for the first byte of a legacy datagram above, followed by
+
+        offset  size  field
+        0       2     magic "OW"
+        2       1     version, currently 1
+        3       1     flags, see PacketFlags
+        4       1     PacketType
+        5       1     reserved, 0
+        6       2     count of elements in the payload
+        8       4     sequence number, counted per sender
+        12      8     send time in nanoseconds since the unix epoch, only if
+                      PacketFlags::timestamped is set
+
+    All fields are little endian. A spikes packet carries count neuron
+    indices of 16 bit, or 32 bit with PacketFlags::wideIndices. With
+    PacketFlags::weighted every index is followed by one byte of weight in
+    units of 1/spikeWeightUnit, so one event can stand for a burst or a strong
+    synapse instead of several identical spikes. Initialisation and content
+    packets carry the same payload as their legacy counterparts.
+
+    A sender that wants more than the legacy format first sends a hello with
+    its own Capabilities; the receiver answers with a capabilities packet
+    describing what it understands, echoing the hello's sequence number, and
+    the sender picks the cheapest encoding both ends support.
+
+    Render nodes of a cluster send what they rendered to the mixer as audio
+    packets, count mono float samples after an AudioBlockHeader. See
+    RenderCluster.h.
+*/
+static constexpr uint8_t packetMagic[2]  = {'O', 'W'};
+static constexpr uint8_t protocolVersion = 1;
+static constexpr size_t packetHeaderSize = 12;
+static constexpr size_t packetTimeSize   = 8;
+static constexpr size_t capabilitiesSize = 6;
+static constexpr uint16_t maxPacketBatch = 1024;
+static constexpr size_t audioHeaderSize  = 20;
+static constexpr uint16_t maxAudioFrames = 256;
+
+// Weight byte of an ordinary spike, up to 255 / 16 times as loud is possible
+static constexpr uint8_t spikeWeightUnit = 16;
+
+enum class PacketType : uint8_t
+{
+    spikes,
+    initialisation,
+    initialisationContent,
+    hello,
+    capabilities,
+    audio,
+    numTypes
+};
+
+namespace PacketFlags
+{
+static constexpr uint8_t timestamped = 1 << 0;
+static constexpr uint8_t wideIndices = 1 << 1;
+static constexpr uint8_t weighted    = 1 << 2;
+static constexpr uint8_t all         = timestamped | wideIndices | weighted;
+}  // namespace PacketFlags
+
+struct PacketHeader
+{
+    uint8_t version;
+    uint8_t flags;
+    PacketType type;
+    uint16_t count;
+    uint32_t sequence;
+    uint64_t sendTimeNanos;  // 0 unless timestamped
+};
+
+/*
+    Payload of hello and capabilities packets, 6 bytes:
+    max version, index widths, timestamp modes, spike options, max batch (16 bit).
+*/
+struct Capabilities
+{
+    // Bit masks of what can be sent or received
+    static constexpr uint8_t index16          = 1 << 0;
+    static constexpr uint8_t index32          = 1 << 1;
+    static constexpr uint8_t untimed          = 1 << 0;
+    static constexpr uint8_t senderClockNanos = 1 << 1;
+    static constexpr uint8_t weightedSpikes   = 1 << 0;
+
+    uint8_t maxVersion;
+    uint8_t indexWidths;
+    uint8_t timestampModes;
+    uint16_t maxBatchSize;
+    uint8_t spikeOptions;
+};
+
+/*
+    Payload of audio packets, 20 bytes followed by count little endian floats:
+    frame position (64 bit), sample rate in Hz (32 bit), shard (16 bit),
+    reserved (16 bit), envelope energy (float).
+
+    The frame position of the first sample counts samples at the packet's rate
+    since the unix epoch, so blocks from different nodes line up by the time
+    they were rendered at. The energy is the sum of the squared envelope gains
+    behind the block, see NeuronSynth::getEnvelopeEnergy().
+*/
+struct AudioBlockHeader
+{
+    uint64_t position;
+    uint32_t sampleRate;
+    uint16_t shard;
+    float energy;
+};
+
+// Writes a header (and its send time if timestamped) to dest, returns the number of bytes written
+inline size_t writePacketHeader(uint8_t* dest, PacketHeader const& header)
+{
+    auto const put = [&dest](uint64_t value, int numBytes) {
+        for (int i = 0; i < numBytes; i++) { *dest++ = static_cast<uint8_t>(value >> (8 * i)); }
+    };
+
+    put(packetMagic[0], 1);
+    put(packetMagic[1], 1);
+    put(header.version, 1);
+    put(header.flags, 1);
+    put(static_cast<uint8_t>(header.type), 1);
+    put(0, 1);
+    put(header.count, 2);
+    put(header.sequence, 4);
+
+    if ((header.flags & PacketFlags::timestamped) == 0) { return packetHeaderSize; }
+
+    put(header.sendTimeNanos, 8);
+    return packetHeaderSize + packetTimeSize;
+}
+
+inline size_t writeCapabilities(uint8_t* dest, Capabilities const& capabilities)
+{
+    dest[0] = capabilities.maxVersion;
+    dest[1] = capabilities.indexWidths;
+    dest[2] = capabilities.timestampModes;
+    dest[3] = capabilities.spikeOptions;
+    dest[4] = static_cast<uint8_t>(capabilities.maxBatchSize);
+    dest[5] = static_cast<uint8_t>(capabilities.maxBatchSize >> 8);
+    return capabilitiesSize;
+}
+
+inline size_t writeAudioBlockHeader(uint8_t* dest, AudioBlockHeader const& block)
+{
+    uint32_t energyBits = 0;
+    std::memcpy(&energyBits, &block.energy, sizeof(energyBits));
+
+    for (int i = 0; i < 8; i++) { dest[i] = static_cast<uint8_t>(block.position >> (8 * i)); }
+    for (int i = 0; i < 4; i++) { dest[8 + i] = static_cast<uint8_t>(block.sampleRate >> (8 * i)); }
+    dest[12] = static_cast<uint8_t>(block.shard);
+    dest[13] = static_cast<uint8_t>(block.shard >> 8);
+    dest[14] = 0;
+    dest[15] = 0;
+    for (int i = 0; i < 4; i++) { dest[16 + i] = static_cast<uint8_t>(energyBits >> (8 * i)); }
+
+    return audioHeaderSize;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+//==============================================================================
+/*
+    Fixed capacity single producer, single consumer ring of spike indices,
+    between one receiving or simulating thread and the audio thread. The
+    storage is allocated once by the constructor; nothing after that ever
+    allocates, locks or waits.
+
+    The capacity is a power of two and the read and write counters run freely,
+    so a slot is found with a mask. The producer's counter and the consumer's
+    counter each sit on a cache line of their own, next to a cached copy of
+    the other side's counter: the producer only reads the consumer's counter
+    when its copy says the ring is full, and the other way round, so in the
+    steady state neither side touches the other's cache line.
+
+    Spikes are moved in whole spans. push() of a span and pop() each copy at
+    most two contiguous runs (the ring may wrap once) and publish the new
+    counter once, however many spikes they moved. Spikes that do not fit are
+    dropped and counted rather than waited for.
+*/
+template <typename Index>
+class SpikeRing
+{
+public:
+    static_assert(std::is_integral<Index>::value, "A SpikeRing carries plain indices");
+
+    // capacity is rounded up to a power of two
+    explicit SpikeRing(uint32_t capacity)
+    {
+        uint32_t roundedCapacity = 1;
+        while (roundedCapacity < capacity) { roundedCapacity <<= 1; }
+
+        storage = std::make_unique<Index[]>(roundedCapacity);
+        mask    = roundedCapacity - 1;
+    }
+
+    SpikeRing(SpikeRing const&) = delete;
+    SpikeRing& operator=(SpikeRing const&) = delete;
+
+    uint32_t getCapacity() const { return mask + 1; }
+
+    //==============================================================================
+    // Producer only. Pushes as many of the count values as fit, returns how many that was.
+    int push(Index const* values, int count)
+    {
+        auto const position = tail.load(std::memory_order_relaxed);
+        auto free           = getCapacity() - (position - cachedHead);
+
+        if (free < static_cast<uint32_t>(count))
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            free       = getCapacity() - (position - cachedHead);
+        }
+
+        auto const numPushed = static_cast<int>(std::min(free, static_cast<uint32_t>(count)));
+        if (numPushed < count)
+        { numOverflows.fetch_add(static_cast<uint64_t>(count - numPushed), std::memory_order_relaxed); }
+        if (numPushed == 0) { return 0; }
+
+        auto const start    = position & mask;
+        auto const firstRun = std::min(static_cast<uint32_t>(numPushed), getCapacity() - start);
+
+        std::memcpy(storage.get() + start, values, firstRun * sizeof(Index));
+        std::memcpy(storage.get(), values + firstRun, (static_cast<uint32_t>(numPushed) - firstRun) * sizeof(Index));
+
+        tail.store(position + static_cast<uint32_t>(numPushed), std::memory_order_release);
+        return numPushed;
+    }
+
+    bool push(Index value) { return push(&value, 1) == 1; }
+
+    //==============================================================================
+    // Consumer only. Hands up to maxCount queued values to fn(Index const* run, int
+    // runLength), in at most two runs straight from the ring, then frees them all at once.
+    template <typename Function>
+    int consume(int maxCount, Function&& fn)
+    {
+        auto const position = head.load(std::memory_order_relaxed);
+        auto available      = cachedTail - position;
+
+        if (available < static_cast<uint32_t>(maxCount))
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            available  = cachedTail - position;
+        }
+
+        auto const numTaken = std::min(available, static_cast<uint32_t>(std::max(maxCount, 0)));
+        if (numTaken == 0) { return 0; }
+
+        auto const start    = position & mask;
+        auto const firstRun = std::min(numTaken, getCapacity() - start);
+
+        fn(static_cast<Index const*>(storage.get() + start), static_cast<int>(firstRun));
+        if (numTaken > firstRun)
+        { fn(static_cast<Index const*>(storage.get()), static_cast<int>(numTaken - firstRun)); }
+
+        head.store(position + numTaken, std::memory_order_release);
+        return static_cast<int>(numTaken);
+    }
+
+    // Consumer only. Copies up to maxCount values to dest, returns how many.
+    int pop(Index* dest, int maxCount)
+    {
+        return consume(maxCount, [&dest](Index const* run, int runLength) {
+            std::memcpy(dest, run, static_cast<size_t>(runLength) * sizeof(Index));
+            dest += runLength;
+        });
+    }
+
+    //==============================================================================
+    // Safe from any thread, approximate while the producer or consumer is busy
+    size_t size() const
+    {
+        // The head first: the tail it is compared with can then only be further ahead
+        auto const position = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - position;
+    }
+
+    uint64_t getNumOverflows() const { return numOverflows.load(std::memory_order_relaxed); }
+
+private:
+    // Read by both sides, written only by the constructor
+    std::unique_ptr<Index[]> storage;
+    uint32_t mask {};
+
+    // Written by the producer
+    alignas(64) std::atomic<uint32_t> tail {0};
+    uint32_t cachedHead {0};
+    std::atomic<uint64_t> numOverflows {0};
+
+    // Written by the consumer
+    alignas(64) std::atomic<uint32_t> head {0};
+    uint32_t cachedTail {0};
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+
+//==============================================================================
+/*
+    Something that produces spikes for the audio thread.
+
+    pullSpikes() is called from the audio callback once per rendered block, so
+    implementations must not block, lock or allocate in it.
+*/
+class SpikeSource
+{
+public:
+    virtual ~SpikeSource() = default;
+
+    // Called from prepareToPlay(), before the first pullSpikes()
+    virtual void prepare(double /*sampleRate*/, int /*maxBlockSize*/) { }
+
+    // Writes the indices of the neurons that fire during the next numSamples
+    // samples into dest (at most maxSpikes, every index below numNeurons) and
+    // returns how many were written.
+    virtual int pullSpikes(int numSamples, int numNeurons, int* dest, int maxSpikes) = 0;
+
+    // As pullSpikes(), and writes the weight of every spike to weights unless
+    // it is nullptr; 1 is an ordinary spike. Sources that have no weights of
+    // their own report every spike at 1.
+    virtual int pullWeightedSpikes(int numSamples, int numNeurons, int* dest, float* weights, int maxSpikes)
+    {
+        auto const numSpikes = pullSpikes(numSamples, numNeurons, dest, maxSpikes);
+        if (weights != nullptr) { std::fill(weights, weights + numSpikes, 1.f); }
+        return numSpikes;
+    }
+};
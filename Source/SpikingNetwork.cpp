@@ -0,0 +1,163 @@
+#include "SpikingNetwork.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+SpikingNetwork::SpikingNetwork(ThreadTuning& tuning)
+    : threadTuning(tuning)
+{
+    build(params);
+}
+
+SpikingNetwork::~SpikingNetwork() { stop(); }
+
+void SpikingNetwork::build(Parameters const& newParameters)
+{
+    stop();
+
+    params = newParameters;
+    random.setSeed(params.seed);
+    numSpikesGenerated.store(0);
+    numSpikesDropped.store(0);
+
+    auto const numNeurons   = std::max(1, params.numNeurons);
+    auto const numPerNeuron = std::min(std::max(0, params.connectionsPerNeuron), numNeurons);
+    auto const numExc       = getNumExcitatory();
+
+    rowStart.resize(static_cast<size_t>(numNeurons) + 1);
+    targets.resize(static_cast<size_t>(numNeurons) * numPerNeuron);
+    weights.resize(targets.size());
+
+    for (int source = 0; source < numNeurons; source++)
+    {
+        auto const first = static_cast<size_t>(source) * numPerNeuron;
+        rowStart[source] = static_cast<int>(first);
+
+        random.fillIndices(targets.data() + first, numPerNeuron, numNeurons);
+        std::sort(targets.begin() + first, targets.begin() + first + numPerNeuron);
+
+        auto const w = source < numExc ? params.excitatoryWeightMv : params.inhibitoryWeightMv;
+        std::fill(weights.begin() + first, weights.begin() + first + numPerNeuron, w);
+    }
+    rowStart[numNeurons] = static_cast<int>(targets.size());
+
+    membrane.assign(numNeurons, 0.f);
+    synapticInput.assign(numNeurons, 0.f);
+    refractoryStepsLeft.assign(numNeurons, 0);
+    noiseBlock.assign(numNeurons, 0u);
+    firedThisStep.assign(numNeurons, 0);
+
+    // Start from random potentials so the network does not fire in lockstep
+    for (auto& v : membrane) { v = random.nextFloat() * params.thresholdMv; }
+
+    auto const dtOverTau = params.timeStepMs / params.membraneTauMs;
+    leak                 = dtOverTau;
+    refractorySteps      = static_cast<int>(std::lround(params.refractoryMs / params.timeStepMs));
+
+    // Uniform noise in [-0.5, 0.5) scaled to the variance of the Ornstein-Uhlenbeck increment
+    noiseScale = params.driveNoiseMv * std::sqrt(2.f * dtOverTau) * std::sqrt(12.f);
+}
+
+void SpikingNetwork::start()
+{
+    if (running.exchange(true)) { return; }
+
+    simulationThread = std::thread([this] { run(); });
+}
+
+void SpikingNetwork::stop()
+{
+    running.store(false);
+
+    if (simulationThread.joinable()) { simulationThread.join(); }
+}
+
+int SpikingNetwork::pullSpikes(int, int numNeurons, int* dest, int maxSpikes)
+{
+    // Copy the queued burst straight into dest, then squeeze out the indices without a voice
+    auto const numTaken = spikeQueue.pop(dest, maxSpikes);
+    int numSpikes       = 0;
+
+    for (int i = 0; i < numTaken; i++)
+    {
+        if (dest[i] < numNeurons) { dest[numSpikes++] = dest[i]; }
+    }
+
+    return numSpikes;
+}
+
+void SpikingNetwork::run()
+{
+    using Clock = std::chrono::steady_clock;
+
+    threadTuning.applyToCurrentThread(ThreadTuning::Role::worker, 0);
+
+    // Simulate one millisecond of model time at once, then sleep until the wall clock catches up
+    auto const stepsPerChunk = std::max(1, static_cast<int>(std::lround(1.f / params.timeStepMs)));
+    auto const chunkDuration = std::chrono::duration<double, std::milli>(stepsPerChunk * params.timeStepMs);
+    auto deadline            = Clock::now();
+
+    while (running.load())
+    {
+        for (int i = 0; i < stepsPerChunk; i++) { simulateStep(); }
+
+        deadline += std::chrono::duration_cast<Clock::duration>(chunkDuration / speed.load());
+        auto const now = Clock::now();
+
+        // Never try to catch up more than 100ms, the spikes would arrive as one burst anyway
+        if (now - deadline > std::chrono::milliseconds(100)) { deadline = now; }
+        else if (deadline > now)
+        {
+            std::this_thread::sleep_until(deadline);
+        }
+    }
+}
+
+void SpikingNetwork::simulateStep()
+{
+    auto const numNeurons = static_cast<int>(membrane.size());
+    auto const mean       = params.driveMeanMv;
+    auto const threshold  = params.thresholdMv;
+    auto const reset      = params.resetMv;
+
+    float* v          = membrane.data();
+    float* input      = synapticInput.data();
+    int* refractory   = refractoryStepsLeft.data();
+    uint32_t const* r = noiseBlock.data();
+
+    random.fill(noiseBlock.data(), numNeurons);
+
+    // Membrane update, written without branches so it compiles to vector code
+    for (int i = 0; i < numNeurons; i++)
+    {
+        auto const noise = (static_cast<float>(r[i] >> 8) * (1.f / 16777216.f) - 0.5f) * noiseScale;
+        auto const next  = v[i] + (mean - v[i]) * leak + noise + input[i];
+
+        v[i]          = refractory[i] > 0 ? reset : next;
+        refractory[i] = std::max(refractory[i] - 1, 0);
+        input[i]      = 0.f;
+    }
+
+    int numFired = 0;
+    for (int i = 0; i < numNeurons; i++)
+    {
+        firedThisStep[numFired] = i;
+        numFired += v[i] >= threshold ? 1 : 0;
+    }
+
+    for (int n = 0; n < numFired; n++)
+    {
+        auto const source  = firedThisStep[n];
+        v[source]          = reset;
+        refractory[source] = refractorySteps;
+
+        for (int s = rowStart[source]; s < rowStart[source + 1]; s++) { input[targets[s]] += weights[s]; }
+    }
+
+    // The whole step's spikes go to the audio thread in one push
+    auto const numDropped = static_cast<uint64_t>(numFired - spikeQueue.push(firedThisStep.data(), numFired));
+
+    numSpikesGenerated.fetch_add(static_cast<uint64_t>(numFired), std::memory_order_relaxed);
+    if (numDropped > 0) { numSpikesDropped.fetch_add(numDropped, std::memory_order_relaxed); }
+}
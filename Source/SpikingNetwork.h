@@ -0,0 +1,108 @@
+#pragma once
+
+#include "FastRandom.h"
+#include "SpikeSource.h"
+#include "SpikeRing.h"
+#include "ThreadTuning.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+/*
+    A sparse network of leaky integrate-and-fire neurons, simulated on its own
+    thread in real time. Every neuron receives a noisy external drive plus the
+    spikes of the neurons projecting onto it; the excitatory/inhibitory balance
+    keeps it in an irregular firing regime.
+
+    The connectivity is stored in CSR form (one row of targets and weights per
+    source neuron), the membrane update runs as one flat loop over all neurons
+    and the resulting spikes go through a lock free queue to the audio thread,
+    which reads them via pullSpikes().
+*/
+class SpikingNetwork : public SpikeSource
+{
+public:
+    struct Parameters
+    {
+        int numNeurons {2000};
+        int connectionsPerNeuron {100};
+        float excitatoryFraction {0.8f};
+
+        float timeStepMs {0.1f};
+        float membraneTauMs {20.f};
+        float refractoryMs {2.f};
+        float thresholdMv {20.f};
+        float resetMv {10.f};
+
+        float excitatoryWeightMv {0.5f};
+        float inhibitoryWeightMv {-2.5f};
+
+        // Diffusion approximation of the external input: mean and standard
+        // deviation of the membrane potential it would cause on its own
+        float driveMeanMv {19.f};
+        float driveNoiseMv {5.f};
+
+        uint64_t seed {1};
+    };
+
+    explicit SpikingNetwork(ThreadTuning& threadTuning);
+    ~SpikingNetwork() override;
+
+    // Rebuilds neurons and connectivity, stops the simulation first if it runs
+    void build(Parameters const& newParameters);
+
+    void start();
+    void stop();
+    bool isRunning() const { return running.load(); }
+
+    // 1 is real time, larger values run the model faster than the wall clock
+    void setSpeed(float newSpeed) { speed.store(newSpeed > 0.f ? newSpeed : 1.f); }
+
+    int pullSpikes(int numSamples, int numNeurons, int* dest, int maxSpikes) override;
+
+    Parameters const& getParameters() const { return params; }
+
+    // Neurons [0, getNumExcitatory()) are excitatory, the rest inhibitory
+    int getNumExcitatory() const
+    {
+        return static_cast<int>(params.excitatoryFraction * std::max(1, params.numNeurons));
+    }
+    uint64_t getNumSpikesGenerated() const { return numSpikesGenerated.load(std::memory_order_relaxed); }
+    uint64_t getNumSpikesDropped() const { return numSpikesDropped.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    void simulateStep();
+
+    ThreadTuning& threadTuning;
+    Parameters params;
+    FastRandom random;
+
+    // CSR connectivity: the targets of neuron i are targets[rowStart[i] .. rowStart[i + 1])
+    std::vector<int> rowStart;
+    std::vector<int> targets;
+    std::vector<float> weights;
+
+    // Neuron state
+    std::vector<float> membrane;
+    std::vector<float> synapticInput;
+    std::vector<int> refractoryStepsLeft;
+    std::vector<uint32_t> noiseBlock;
+    std::vector<int> firedThisStep;
+
+    float leak {};
+    float noiseScale {};
+    int refractorySteps {};
+
+    SpikeRing<int> spikeQueue {1 << 16};
+
+    std::thread simulationThread;
+    std::atomic<bool> running {false};
+    std::atomic<float> speed {1.f};
+    std::atomic<uint64_t> numSpikesGenerated {0};
+    std::atomic<uint64_t> numSpikesDropped {0};
+};
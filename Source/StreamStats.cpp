@@ -0,0 +1,131 @@
+#include "StreamStats.h"
+
+#include <cmath>
+
+//==============================================================================
+double StreamStats::getBucketUpperBound(int bucket) { return std::ldexp(1.0e-6, bucket); }
+
+double StreamStats::getLatencyQuantile(double fraction) const
+{
+    uint64_t total = 0;
+    for (auto count : latencyBuckets) { total += count; }
+    if (total == 0) { return 0.0; }
+
+    auto const target = static_cast<double>(total) * fraction;
+    uint64_t below    = 0;
+
+    for (int i = 0; i < numLatencyBuckets; i++)
+    {
+        below += latencyBuckets[static_cast<size_t>(i)];
+        if (static_cast<double>(below) >= target) { return getBucketUpperBound(i); }
+    }
+
+    return getBucketUpperBound(numLatencyBuckets - 1);
+}
+
+juce::String StreamStats::getSummary() const
+{
+    if (numPackets == 0) { return {}; }
+
+    auto const expected = numPackets + getNumLost();
+    auto summary        = "loss " + juce::String(100.0 * getNumLost() / expected, 2) + "%, "
+                   + juce::String(numReordered) + " late, " + juce::String(numDuplicates) + " dup";
+
+    if (numTimed > 0)
+    {
+        summary << ", latency p50 < " << juce::String(getLatencyQuantile(0.5) * 1000.0, 2) << " ms, p99 < "
+                << juce::String(getLatencyQuantile(0.99) * 1000.0, 2) << " ms";
+    }
+
+    return summary;
+}
+
+//==============================================================================
+void StreamCounters::addLatency(int64_t nanos)
+{
+    // Clocks that are not in sync can make packets look like they arrived early
+    auto const micros = nanos > 0 ? static_cast<uint64_t>(nanos) / 1000 : 0;
+
+    int bucket = 0;
+    while (bucket < StreamStats::numLatencyBuckets - 1 && micros >= (uint64_t {1} << bucket)) { bucket++; }
+
+    latencyBuckets[static_cast<size_t>(bucket)].fetch_add(1, std::memory_order_relaxed);
+    latencySumNanos.fetch_add(nanos > 0 ? static_cast<uint64_t>(nanos) : 0, std::memory_order_relaxed);
+}
+
+void StreamCounters::addTo(StreamStats& stats) const
+{
+    stats.numPackets += numPackets.load(std::memory_order_relaxed);
+    stats.numGaps += numGaps.load(std::memory_order_relaxed);
+    stats.numReordered += numReordered.load(std::memory_order_relaxed);
+    stats.numDuplicates += numDuplicates.load(std::memory_order_relaxed);
+    stats.latencySumSeconds += static_cast<double>(latencySumNanos.load(std::memory_order_relaxed)) * 1.0e-9;
+
+    for (size_t i = 0; i < latencyBuckets.size(); i++)
+    {
+        auto const count = latencyBuckets[i].load(std::memory_order_relaxed);
+        stats.latencyBuckets[i] += count;
+        stats.numTimed += count;
+    }
+}
+
+//==============================================================================
+void SequenceTracker::track(uint64_t senderKey, uint32_t sequence, StreamCounters& counters)
+{
+    counters.addPacket();
+    clock++;
+
+    Sender* sender = nullptr;
+    Sender* oldest = &senders[0];
+
+    for (auto& s : senders)
+    {
+        if (s.active && s.key == senderKey)
+        {
+            sender = &s;
+            break;
+        }
+
+        if (!s.active || (oldest->active && s.lastUsed < oldest->lastUsed)) { oldest = &s; }
+    }
+
+    if (sender == nullptr)
+    {
+        *oldest = {senderKey, clock, 1, sequence, true};
+        return;
+    }
+
+    sender->lastUsed = clock;
+
+    // Wrap around safe distance from the highest sequence number so far
+    auto const ahead = sequence - sender->highest;
+    auto const back  = sender->highest - sequence;
+
+    if (ahead != 0 && ahead < restartDistance)
+    {
+        if (ahead > 1) { counters.addGap(ahead - 1); }
+
+        sender->seen    = ahead < 64 ? (sender->seen << ahead) | 1 : 1;
+        sender->highest = sequence;
+    }
+    else if (back < 64)
+    {
+        auto const bit = uint64_t {1} << back;
+
+        if ((sender->seen & bit) != 0) { counters.addDuplicate(); }
+        else
+        {
+            sender->seen |= bit;
+            counters.addReordered();
+        }
+    }
+    else if (back < restartDistance)
+    {
+        // Too old to tell apart from a duplicate, most likely it was reordered
+        counters.addReordered();
+    }
+    else
+    {
+        *sender = {senderKey, clock, 1, sequence, true};
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+//==============================================================================
+/*
+    Health of the versioned spike stream: how many packets arrived, how many
+    went missing, came late or twice, and how long they took from the sender's
+    clock to ours.
+
+    A receive thread owns one StreamCounters and bumps it with relaxed atomics;
+    any other thread can add a snapshot of it into a StreamStats at any time.
+    Latency is kept as a histogram with power of two buckets in microseconds,
+    so quantiles are accurate to within a factor of two, which is plenty to
+    tell a congested network from an overloaded renderer.
+*/
+struct StreamStats
+{
+    static constexpr int numLatencyBuckets = 24;  // bucket i: below 2^i microseconds, the last one open ended
+
+    uint64_t numPackets {};
+    uint64_t numGaps {};       // packets found missing when a later one arrived
+    uint64_t numReordered {};  // of those, the ones that turned up late after all
+    uint64_t numDuplicates {};
+    uint64_t numTimed {};
+    double latencySumSeconds {};
+    std::array<uint64_t, numLatencyBuckets> latencyBuckets {};
+
+    uint64_t getNumLost() const { return numGaps > numReordered ? numGaps - numReordered : 0; }
+
+    // Upper bound in seconds of the bucket the given fraction of timed packets falls into
+    double getLatencyQuantile(double fraction) const;
+    static double getBucketUpperBound(int bucket);
+
+    // One line for the status bar, empty while no versioned packets arrived
+    juce::String getSummary() const;
+};
+
+//==============================================================================
+class StreamCounters
+{
+public:
+    void addPacket() { numPackets.fetch_add(1, std::memory_order_relaxed); }
+    void addGap(uint64_t numMissing) { numGaps.fetch_add(numMissing, std::memory_order_relaxed); }
+    void addReordered() { numReordered.fetch_add(1, std::memory_order_relaxed); }
+    void addDuplicate() { numDuplicates.fetch_add(1, std::memory_order_relaxed); }
+    void addLatency(int64_t nanos);
+
+    void addTo(StreamStats& stats) const;
+
+private:
+    std::atomic<uint64_t> numPackets {0};
+    std::atomic<uint64_t> numGaps {0};
+    std::atomic<uint64_t> numReordered {0};
+    std::atomic<uint64_t> numDuplicates {0};
+    std::atomic<uint64_t> latencySumNanos {0};
+    std::array<std::atomic<uint64_t>, StreamStats::numLatencyBuckets> latencyBuckets {};
+};
+
+//==============================================================================
+/*
+    Sequence numbers of up to maxNumSenders senders, told apart by an address
+    key. Each sender remembers its highest sequence number and which of the 64
+    before it have been seen, which is enough to tell a late packet from a
+    duplicate. A sender that is silent the longest makes room for a new one,
+    and a jump of more than restartDistance is taken as the sender restarting.
+
+    Only ever touched by the receive thread that owns it.
+*/
+class SequenceTracker
+{
+public:
+    static constexpr int maxNumSenders        = 32;
+    static constexpr uint32_t restartDistance = 1u << 20;
+
+    void track(uint64_t senderKey, uint32_t sequence, StreamCounters& counters);
+
+private:
+    struct Sender
+    {
+        uint64_t key;
+        uint64_t lastUsed;
+        uint64_t seen;  // bit n: highest - n has arrived
+        uint32_t highest;
+        bool active;
+    };
+
+    std::array<Sender, maxNumSenders> senders {};
+    uint64_t clock {};
+};
@@ -0,0 +1,190 @@
+#include "ThreadTuning.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if JUCE_LINUX || JUCE_MAC
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+namespace
+{
+char const* const roleNames[] = {"audio", "receiver", "worker"};
+
+juce::String describe(int result)
+{
+    if (result == 0) { return "ok"; }
+
+    juce::String text = std::strerror(result);
+
+    if (result == EPERM)
+    {
+#if JUCE_LINUX
+        text << " (needs CAP_SYS_NICE / CAP_IPC_LOCK or rtprio and memlock limits in /etc/security/limits.conf)";
+#else
+        text << " (missing privileges)";
+#endif
+    }
+
+    return text;
+}
+}  // namespace
+
+ThreadTuning::ThreadTuning()
+{
+    for (auto& r : priorityResults) { r.store(notApplied); }
+    for (auto& r : affinityResults) { r.store(notApplied); }
+}
+
+void ThreadTuning::parseCommandLine(juce::String const& commandLine)
+{
+    for (auto const& argument : juce::StringArray::fromTokens(commandLine, " ", "\""))
+    {
+        if (argument == "--mlock")
+        {
+            lockMemoryRequested = true;
+            continue;
+        }
+
+        for (int r = 0; r < numRoles; r++)
+        {
+            auto const prefix = juce::String("--") + roleNames[r] + "-";
+            if (!argument.startsWith(prefix)) { continue; }
+
+            auto const option = argument.fromFirstOccurrenceOf(prefix, false, false);
+            auto const value  = option.fromFirstOccurrenceOf("=", false, false);
+            auto& s           = settings[r];
+
+            if (option.startsWith("priority=")) { s.priority = juce::jlimit(0, 99, value.getIntValue()); }
+
+            if (option.startsWith("cpu="))
+            {
+                s.numCpus = 0;
+                ignoredCpus[r].clear();
+
+                for (auto const& token : juce::StringArray::fromTokens(value, ",", ""))
+                {
+                    auto const text = token.trim();
+                    if (text.isEmpty() || s.numCpus >= maxCpus) { continue; }
+
+                    // An index past the cpu set would be undefined behaviour in CPU_SET() or the affinity mask
+                    auto const cpu = text.getIntValue();
+
+                    if (text.containsOnly("0123456789") && cpu >= 0 && cpu < getNumPinnableCpus())
+                    {
+                        s.cpus[s.numCpus++] = cpu;
+                    }
+                    else
+                    {
+                        ignoredCpus[r].add(text);
+                    }
+                }
+            }
+        }
+    }
+}
+
+int ThreadTuning::getNumPinnableCpus()
+{
+#if JUCE_LINUX
+    return std::min(static_cast<int>(CPU_SETSIZE), juce::SystemStats::getNumCpus());
+#else
+    // The affinity mask has one bit per cpu
+    return std::min(32, juce::SystemStats::getNumCpus());
+#endif
+}
+
+void ThreadTuning::applyToCurrentThread(Role role, int instance)
+{
+    auto const& s = settings[index(role)];
+
+    if (s.priority > 0)
+    {
+#if JUCE_LINUX || JUCE_MAC
+        sched_param parameters {};
+        parameters.sched_priority = s.priority;
+        priorityResults[index(role)].store(pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters));
+#else
+        auto const ok = juce::Thread::setCurrentThreadPriority(10);
+        priorityResults[index(role)].store(ok ? 0 : EPERM);
+#endif
+    }
+
+    if (s.numCpus > 0)
+    {
+        auto const cpu = s.cpus[static_cast<size_t>(instance % s.numCpus)];
+
+#if JUCE_LINUX
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        affinityResults[index(role)].store(pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet));
+#elif JUCE_MAC
+        // macOS has no hard pinning, only affinity hints
+        juce::ignoreUnused(cpu);
+        affinityResults[index(role)].store(ENOTSUP);
+#else
+        juce::Thread::setCurrentThreadAffinityMask(1u << cpu);
+        affinityResults[index(role)].store(0);
+#endif
+    }
+}
+
+juce::Result ThreadTuning::lockMemory()
+{
+    if (!lockMemoryRequested) { return juce::Result::ok(); }
+
+#if JUCE_LINUX || JUCE_MAC
+    auto const result = mlockall(MCL_CURRENT | MCL_FUTURE) == 0 ? 0 : errno;
+#else
+    auto const result = ENOTSUP;
+#endif
+
+    lockResult.store(result);
+    return result == 0 ? juce::Result::ok() : juce::Result::fail("mlockall: " + describe(result));
+}
+
+void ThreadTuning::prefault(void const* data, size_t numBytes)
+{
+    static constexpr size_t pageSize = 4096;
+
+    auto const bytes = static_cast<unsigned char const volatile*>(data);
+    unsigned char sum {};
+
+    for (size_t i = 0; i < numBytes; i += pageSize) { sum += bytes[i]; }
+    if (numBytes > 0) { sum += bytes[numBytes - 1]; }
+
+    juce::ignoreUnused(sum);
+}
+
+juce::String ThreadTuning::getReport() const
+{
+    juce::StringArray lines;
+
+    for (int r = 0; r < numRoles; r++)
+    {
+        auto const priority = priorityResults[r].load();
+        auto const affinity = affinityResults[r].load();
+
+        auto const role     = juce::String(roleNames[r]);
+
+        if (settings[r].priority > 0 && priority != notApplied)
+        { lines.add(role + " priority " + juce::String(settings[r].priority) + ": " + describe(priority)); }
+
+        if (settings[r].numCpus > 0 && affinity != notApplied) { lines.add(role + " cpu pinning: " + describe(affinity)); }
+
+        if (!ignoredCpus[r].isEmpty())
+        {
+            lines.add(role + " cpu " + ignoredCpus[r].joinIntoString(",") + ": not applied, only cpus 0 to "
+                      + juce::String(getNumPinnableCpus() - 1) + " can be pinned to");
+        }
+    }
+
+    if (lockMemoryRequested && lockResult.load() != notApplied) { lines.add("mlockall: " + describe(lockResult.load())); }
+
+    return lines.joinIntoString(", ");
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+
+//==============================================================================
+/*
+    Scheduling setup for the engine's threads: SCHED_FIFO priorities, CPU
+    pinning and locking the process memory, so that neither page faults nor
+    the normal scheduler get in the way of spike delivery and rendering.
+
+    Configured from the command line, for example
+
+        --audio-priority=80 --audio-cpu=2
+        --receiver-priority=70 --receiver-cpu=3,4
+        --worker-cpu=5 --mlock
+
+    Every thread calls applyToCurrentThread() with its role once it runs; the
+    outcome is remembered and getReport() describes it, including missing
+    privileges. Nothing is changed for settings that were not given. CPU
+    indices this machine does not have are ignored and reported as not
+    applied.
+*/
+class ThreadTuning
+{
+public:
+    enum class Role
+    {
+        audio,
+        receiver,
+        worker,
+    };
+
+    static constexpr int numRoles = 3;
+    static constexpr int maxCpus  = 16;
+
+    struct Settings
+    {
+        int priority {0};  // SCHED_FIFO priority 1..99, 0 keeps the default scheduling
+        std::array<int, maxCpus> cpus {};
+        int numCpus {0};  // no pinning when empty; threads of one role take turns over the list
+    };
+
+    ThreadTuning();
+
+    void parseCommandLine(juce::String const& commandLine);
+
+    Settings& getSettings(Role role) { return settings[index(role)]; }
+    bool shouldLockMemory() const { return lockMemoryRequested; }
+    void setLockMemory(bool shouldLock) { lockMemoryRequested = shouldLock; }
+
+    // Realtime safe: a couple of syscalls, no allocation. instance picks the cpu
+    // from the list when several threads share a role.
+    void applyToCurrentThread(Role role, int instance = 0);
+
+    // Locks all current and future pages of the process, if requested. Call outside the audio callback.
+    juce::Result lockMemory();
+
+    // Touches every page of the given memory, so it is resident before the audio callback needs it
+    static void prefault(void const* data, size_t numBytes);
+
+    juce::String getReport() const;
+
+private:
+    static int index(Role role) { return static_cast<int>(role); }
+
+    // Number of cpus that can be pinned to, indices run from 0 to this minus one
+    static int getNumPinnableCpus();
+
+    std::array<Settings, numRoles> settings {};
+    std::array<juce::StringArray, numRoles> ignoredCpus {};
+    bool lockMemoryRequested {false};
+
+    // Outcome per role: notApplied, 0 for success or the errno of the failed call
+    static constexpr int notApplied = -1;
+    std::array<std::atomic<int>, numRoles> priorityResults;
+    std::array<std::atomic<int>, numRoles> affinityResults;
+    std::atomic<int> lockResult {notApplied};
+};
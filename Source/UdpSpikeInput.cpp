@@ -0,0 +1,522 @@
+#include "UdpSpikeInput.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+#if JUCE_LINUX
+    #include <sys/eventfd.h>
+#endif
+
+//==============================================================================
+void NeuronInitialisation::handleInitialisation(uint16_t numFrequencies, uint16_t newChunkSize)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    systemIsInInitMode.store(true);
+    listOfFrequencies.clear();
+    mergedVoices.clear();
+    mergedVoicesVersion++;
+
+    numFrequenciesReceived = numFrequencies;
+    chunkSize              = newChunkSize;
+
+    DBG("Initialisation Begin.\nNum Neurons:");
+    DBG(numFrequenciesReceived);
+    DBG("chunk Size:");
+    DBG(chunkSize);
+}
+
+bool NeuronInitialisation::handleContent(SpikeDecoder::ByteView frequencies)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto const numInChunk = std::min(static_cast<size_t>(chunkSize), frequencies.size() / 4);
+
+    // Checked before anything is taken, up to the terminating 0
+    for (size_t i = 0; i < numInChunk; i++)
+    {
+        auto const frequency = frequencies.readFloat(i * 4);
+        if (frequency == 0) { break; }
+
+        if (!std::isfinite(frequency) || frequency < 0 || frequency > maxFrequency)
+        {
+            DBG("Initialisation chunk rejected, frequency " << frequency);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < numInChunk; i++)
+    {
+        auto const frequency = frequencies.readFloat(i * 4);
+
+        if (frequency == 0)
+        {
+            DBG("Initialisation Succesfull - 0 reached");
+            finish();
+            return true;
+        }
+
+        listOfFrequencies.push_back(frequency);
+        DBG(frequency);
+    }
+
+    if (listOfFrequencies.size() == numFrequenciesReceived)
+    {
+        DBG("Initialisation Succesfull - vector filled");
+        finish();
+        return true;
+    }
+
+    if (listOfFrequencies.size() > numFrequenciesReceived)
+    {
+        DBG("Initialisation Overload");
+        return true;
+    }
+
+    DBG("chunk done, waiting for next one");
+    DBG(listOfFrequencies.size());
+    return true;
+}
+
+void NeuronInitialisation::finish()
+{
+    mergedVoices.build(listOfFrequencies.data(), static_cast<int>(listOfFrequencies.size()),
+                       mergeToleranceCents.load());
+    mergedVoicesVersion++;
+    systemIsInInitMode.store(false);
+}
+
+//==============================================================================
+namespace
+{
+// FNV-1a, only used to tell senders apart
+uint64_t hashBytes(void const* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    auto const* bytes = static_cast<uint8_t const*>(data);
+
+    for (size_t i = 0; i < size; i++) { hash = (hash ^ bytes[i]) * 1099511628211ull; }
+
+    return hash;
+}
+
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+uint64_t makeSenderKey(sockaddr_storage const& address)
+{
+    if (address.ss_family == AF_INET)
+    {
+        auto const& v4 = reinterpret_cast<sockaddr_in const&>(address);
+        return (static_cast<uint64_t>(v4.sin_addr.s_addr) << 16) | v4.sin_port;
+    }
+
+    if (address.ss_family == AF_INET6)
+    {
+        auto const& v6 = reinterpret_cast<sockaddr_in6 const&>(address);
+        return hashBytes(&v6.sin6_port, sizeof(v6.sin6_port), hashBytes(&v6.sin6_addr, sizeof(v6.sin6_addr)));
+    }
+
+    return 0;
+}
+#else
+uint64_t makeSenderKey(juce::String const& address, int port)
+{
+    return hashBytes(&port, sizeof(port), hashBytes(address.toRawUTF8(), address.getNumBytesAsUTF8()));
+}
+#endif
+}  // namespace
+
+//==============================================================================
+UdpSpikeReceiver::UdpSpikeReceiver(int id, Queue& queueToFill, NeuronInitialisation& sharedInitialisation,
+                                   SpikeRecorder& spikeRecorder, ThreadTuning& tuning)
+    : receiverId(id)
+    , queue(queueToFill)
+    , initialisation(sharedInitialisation)
+    , recorder(spikeRecorder)
+    , threadTuning(tuning)
+{
+}
+
+UdpSpikeReceiver::~UdpSpikeReceiver() { stop(); }
+
+juce::Result UdpSpikeReceiver::start(int portToBind, bool sharePort)
+{
+    stop();
+
+    port = portToBind;
+    udp  = std::make_unique<juce::DatagramSocket>();
+
+    if (sharePort)
+    {
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+        int const enable = 1;
+        setsockopt(udp->getRawSocketHandle(), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+#else
+        jassertfalse;  // SO_REUSEPORT is not available, only the first listener on this port will bind
+#endif
+    }
+
+    if (!udp->bindToPort(port, "0.0.0.0"))
+    {
+        udp.reset();
+        return juce::Result::fail("Could not bind UDP port " + juce::String(port));
+    }
+
+    if (!openWakeup())
+    {
+        udp.reset();
+        return juce::Result::fail("Could not create the receiver wakeup event");
+    }
+
+    stopRequested.store(false);
+    udpThread = std::thread([this] { run(); });
+    return juce::Result::ok();
+}
+
+void UdpSpikeReceiver::stop()
+{
+    if (udpThread.joinable())
+    {
+        stopRequested.store(true);
+        wakeUp();
+        udpThread.join();
+    }
+
+    closeWakeup();
+    udp.reset();
+}
+
+juce::Result UdpSpikeReceiver::rebind(int newPort, bool sharePort) { return start(newPort, sharePort); }
+
+void UdpSpikeReceiver::run()
+{
+    threadTuning.applyToCurrentThread(ThreadTuning::Role::receiver, receiverId);
+
+    DBG("UDP Thread listening on port " << port);
+
+    while (!stopRequested.load())
+    {
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+        pollfd fds[2] = {{udp->getRawSocketHandle(), POLLIN, 0}, {wakeupFds[0], POLLIN, 0}};
+
+        // The timeout is only a safety net, stop() always wakes the poll up
+        if (poll(fds, 2, 1000) <= 0) { continue; }
+        if ((fds[1].revents & POLLIN) != 0) { break; }
+        if ((fds[0].revents & (POLLERR | POLLNVAL)) != 0) { break; }
+        if ((fds[0].revents & POLLIN) != 0) { drainSocket(); }
+#else
+        if (udp->waitUntilReady(true, 50) == 1) { drainSocket(); }
+#endif
+    }
+}
+
+void UdpSpikeReceiver::drainSocket()
+{
+    uint8_t buffer[5000] = {};
+
+    while (!stopRequested.load(std::memory_order_relaxed))
+    {
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+        // recvfrom keeps the sender as a plain address, without building a string per datagram
+        senderAddressLength = sizeof(senderAddress);
+        auto const numBytes = static_cast<int>(recvfrom(udp->getRawSocketHandle(), buffer, sizeof(buffer), MSG_DONTWAIT,
+                                                        reinterpret_cast<sockaddr*>(&senderAddress),
+                                                        &senderAddressLength));
+#else
+        auto const numBytes = udp->read(static_cast<void*>(buffer), sizeof(buffer), false, senderAddress, senderPort);
+#endif
+        if (numBytes <= 0) { break; }
+
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+        senderKey = makeSenderKey(senderAddress);
+#else
+        senderKey = makeSenderKey(senderAddress, senderPort);
+#endif
+        handleDatagram(buffer, numBytes);
+    }
+}
+
+bool UdpSpikeReceiver::openWakeup()
+{
+#if JUCE_LINUX
+    wakeupFds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    wakeupFds[1] = wakeupFds[0];
+    return wakeupFds[0] >= 0;
+#elif JUCE_MAC || JUCE_BSD
+    if (pipe(wakeupFds) != 0) { return false; }
+
+    fcntl(wakeupFds[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakeupFds[1], F_SETFL, O_NONBLOCK);
+    return true;
+#else
+    return true;
+#endif
+}
+
+void UdpSpikeReceiver::closeWakeup()
+{
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+    if (wakeupFds[0] >= 0) { close(wakeupFds[0]); }
+    if (wakeupFds[1] >= 0 && wakeupFds[1] != wakeupFds[0]) { close(wakeupFds[1]); }
+#endif
+    wakeupFds[0] = -1;
+    wakeupFds[1] = -1;
+}
+
+void UdpSpikeReceiver::wakeUp()
+{
+#if JUCE_LINUX
+    uint64_t const one = 1;
+    juce::ignoreUnused(write(wakeupFds[1], &one, sizeof(one)));
+#elif JUCE_MAC || JUCE_BSD
+    char const byte = 1;
+    juce::ignoreUnused(write(wakeupFds[1], &byte, 1));
+#endif
+}
+
+void UdpSpikeReceiver::handleDatagram(uint8_t const* buffer, int numBytes)
+{
+    auto const error = SpikeDecoder::decode(buffer, static_cast<size_t>(numBytes), *this);
+    flushStaged();
+
+    switch (error)
+    {
+        case SpikeDecoder::Error::none: break;
+
+        // Anything else comes from a newer or a broken sender, it is counted rather than trusted
+        case SpikeDecoder::Error::unknownType:
+        case SpikeDecoder::Error::unsupported: numUnknownMessages.fetch_add(1, std::memory_order_relaxed); break;
+
+        case SpikeDecoder::Error::empty:
+        case SpikeDecoder::Error::truncated:
+        case SpikeDecoder::Error::badLength: numMalformedMessages.fetch_add(1, std::memory_order_relaxed); break;
+    }
+}
+
+void UdpSpikeReceiver::onPacket(PacketHeader const& header)
+{
+    sequenceTracker.track(senderKey, header.sequence, streamCounters);
+
+    if ((header.flags & PacketFlags::timestamped) != 0)
+    {
+        auto const now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+
+        streamCounters.addLatency(static_cast<int64_t>(now) - static_cast<int64_t>(header.sendTimeNanos));
+    }
+}
+
+void UdpSpikeReceiver::onPerformance(uint32_t index, uint8_t weight)
+{
+    // Wide indices beyond what the queue can carry cannot belong to any voice
+    if (index > maxQueuedIndex)
+    {
+        numMalformedMessages.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    numSpikes.fetch_add(1, std::memory_order_relaxed);
+
+    if (numStaged == static_cast<int>(staged.size())) { flushStaged(); }
+    staged[static_cast<size_t>(numStaged++)] = index | (static_cast<uint32_t>(weight) << 24);
+
+    recorder.record(static_cast<int>(index), receiverId);
+}
+
+void UdpSpikeReceiver::flushStaged()
+{
+    // The queue never grows, spikes that do not fit are counted by it and lost
+    queue.push(staged.data(), numStaged);
+    numStaged = 0;
+}
+
+void UdpSpikeReceiver::onInitialisation(uint16_t numFrequencies, uint16_t chunkSize)
+{
+    numInitialisationMessages.fetch_add(1, std::memory_order_relaxed);
+    initialisation.handleInitialisation(numFrequencies, chunkSize);
+}
+
+void UdpSpikeReceiver::onInitialisationContent(SpikeDecoder::ByteView frequencies)
+{
+    numInitialisationMessages.fetch_add(1, std::memory_order_relaxed);
+
+    // Counted like a truncated datagram, nothing of it reaches the renderer
+    if (!initialisation.handleContent(frequencies)) { numMalformedMessages.fetch_add(1, std::memory_order_relaxed); }
+}
+
+void UdpSpikeReceiver::onHello(PacketHeader const& header, Capabilities const& sender)
+{
+    DBG("Hello from a sender speaking version " << static_cast<int>(sender.maxVersion) << ", batches of up to "
+        << static_cast<int>(sender.maxBatchSize));
+
+    uint8_t reply[packetHeaderSize + capabilitiesSize];
+
+    auto size = writePacketHeader(reply, {protocolVersion, 0, PacketType::capabilities, 1, header.sequence, 0});
+    size += writeCapabilities(reply + size, getCapabilities());
+
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+    sendto(udp->getRawSocketHandle(), reply, size, 0, reinterpret_cast<sockaddr const*>(&senderAddress),
+           senderAddressLength);
+#else
+    udp->write(senderAddress, senderPort, reply, static_cast<int>(size));
+#endif
+}
+
+//==============================================================================
+UdpSpikeInput::UdpSpikeInput(SpikeRecorder& spikeRecorder, ThreadTuning& tuning)
+    : recorder(spikeRecorder)
+    , threadTuning(tuning)
+{
+    for (int i = 0; i < maxNumReceivers; i++)
+    {
+        queues[i]    = std::make_unique<UdpSpikeReceiver::Queue>(4096);
+        receivers[i] = std::make_unique<UdpSpikeReceiver>(i, *queues[i], initialisation, recorder, threadTuning);
+    }
+}
+
+UdpSpikeInput::~UdpSpikeInput() { stop(); }
+
+void UdpSpikeInput::stop()
+{
+    for (auto& receiver : receivers) { receiver->stop(); }
+
+    const juce::SpinLock::ScopedLockType lock(sharedRingLock);
+    sharedRing.close();
+}
+
+juce::Result UdpSpikeInput::updateSharedRing(juce::String const& ringName)
+{
+    auto const name = ringName.toStdString();
+
+    // Simulators attached to the ring keep writing into it, so it survives as long as its name does
+    if (sharedRing.isOpen() && sharedRing.getName() == name) { return juce::Result::ok(); }
+
+    const juce::SpinLock::ScopedLockType lock(sharedRingLock);
+    sharedRing.close();
+
+    if (name.empty() || sharedRing.create(name, sharedRingCapacity)) { return juce::Result::ok(); }
+    return juce::Result::fail(sharedRing.getLastError());
+}
+
+juce::Result UdpSpikeInput::setPorts(juce::String const& portList)
+{
+    struct Listener
+    {
+        int port;
+        bool shared;
+    };
+
+    std::vector<Listener> listeners;
+    juce::String sharedRingName;
+
+    for (auto const& token : juce::StringArray::fromTokens(portList, ",; ", ""))
+    {
+        auto const entry = token.trim().toLowerCase();
+        if (entry.isEmpty()) { continue; }
+
+        if (entry.startsWith("shm"))
+        {
+            auto const name = token.trim().fromFirstOccurrenceOf(":", false, false);
+            sharedRingName  = name.isEmpty() ? juce::String(defaultSharedRingName)
+                                             : (name.startsWith("/") ? name : "/" + name);
+            continue;
+        }
+
+        auto const port  = entry.upToFirstOccurrenceOf("x", false, false).getIntValue();
+        auto const count = entry.containsChar('x') ? entry.fromFirstOccurrenceOf("x", false, false).getIntValue() : 1;
+
+        if (port <= 0 || port > 65535 || count <= 0)
+        { return juce::Result::fail("Invalid UDP listener '" + token + "', expected port or portxcount"); }
+
+        for (int i = 0; i < count; i++) { listeners.push_back({port, count > 1}); }
+    }
+
+    if (listeners.empty() && sharedRingName.isEmpty()) { return juce::Result::fail("No UDP port given"); }
+    if (listeners.size() > static_cast<size_t>(maxNumReceivers))
+    { return juce::Result::fail("At most " + juce::String(maxNumReceivers) + " UDP listeners are supported"); }
+
+    // Only the receivers restart, the shared ring is left alone unless its name changed
+    for (auto& receiver : receivers) { receiver->stop(); }
+
+    auto const ringResult = updateSharedRing(sharedRingName);
+    juce::String failedPorts;
+
+    for (size_t i = 0; i < listeners.size(); i++)
+    {
+        auto const result = receivers[i]->rebind(listeners[i].port, listeners[i].shared);
+        if (result.failed()) { failedPorts << " " << juce::String(listeners[i].port); }
+    }
+
+    if (failedPorts.isNotEmpty()) { return juce::Result::fail("Could not bind UDP port(s)" + failedPorts); }
+    return ringResult;
+}
+
+size_t UdpSpikeInput::getQueueDepth() const
+{
+    size_t depth = 0;
+    for (auto const& q : queues) { depth += q->size(); }
+    return depth;
+}
+
+StreamStats UdpSpikeInput::getStreamStats() const
+{
+    StreamStats stats;
+    for (auto const& receiver : receivers) { receiver->addStreamStats(stats); }
+    return stats;
+}
+
+int UdpSpikeInput::pullSpikes(int numSamples, int numNeurons, int* dest, int maxSpikes)
+{
+    return pullWeightedSpikes(numSamples, numNeurons, dest, nullptr, maxSpikes);
+}
+
+int UdpSpikeInput::pullWeightedSpikes(int, int numNeurons, int* dest, float* weights, int maxSpikes)
+{
+    // Take a burst of spikes from every queue in turn until all are empty or dest is full
+    static constexpr int spikesPerTurn = 64;
+
+    int numSpikes   = 0;
+    int emptyInARow = 0;
+
+    {
+        const juce::SpinLock::ScopedTryLockType lock(sharedRingLock);
+
+        if (lock.isLocked() && sharedRing.isOpen()) { numSpikes = sharedRing.pop(dest, maxSpikes, numNeurons); }
+    }
+
+    // The shared ring only carries plain spikes
+    if (weights != nullptr) { std::fill(weights, weights + numSpikes, 1.f); }
+
+    while (numSpikes < maxSpikes && emptyInARow < maxNumReceivers)
+    {
+        auto& q   = *queues[nextQueue];
+        nextQueue = (nextQueue + 1) % maxNumReceivers;
+
+        auto const unpack = [&](uint32_t const* run, int runLength) {
+            for (int i = 0; i < runLength; i++)
+            {
+                auto const index = static_cast<int>(run[i] & UdpSpikeReceiver::maxQueuedIndex);
+
+                if (index < numNeurons)
+                {
+                    if (weights != nullptr) { weights[numSpikes] = static_cast<float>(run[i] >> 24) / spikeWeightUnit; }
+                    dest[numSpikes++] = index;
+                }
+            }
+        };
+
+        auto const numTaken = q.consume(std::min(spikesPerTurn, maxSpikes - numSpikes), unpack);
+
+        emptyInARow = numTaken == 0 ? emptyInARow + 1 : 0;
+    }
+
+    return numSpikes;
+}
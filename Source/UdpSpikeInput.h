@@ -0,0 +1,238 @@
+#pragma once
+
+#include "FrequencyIndex.h"
+#include "SharedSpikeRing.h"
+#include "SpikeDecoder.h"
+#include "SpikeLog.h"
+#include "SpikeProtocol.h"
+#include "SpikeRing.h"
+#include "SpikeSource.h"
+#include "StreamStats.h"
+#include "ThreadTuning.h"
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+    #include <sys/socket.h>
+#endif
+
+//==============================================================================
+/*
+    Neuron frequencies announced by the simulator through Initialisation and
+    InitialisationContent messages. Shared by all receivers, which may get the
+    chunks of one initialisation on different threads.
+
+    A chunk holding a frequency that is not a number, negative or above
+    maxFrequency is rejected as a whole, so the neurons after it keep their
+    indices; the sender has to send it again.
+
+    Once all frequencies are in, the neurons sharing a frequency are merged
+    into one oscillator each, see FrequencyIndex; mergedVoices counts up
+    every time it is rebuilt or cleared.
+*/
+struct NeuronInitialisation
+{
+    // Above the Nyquist frequency of every usual device rate
+    static constexpr float maxFrequency = 24000.f;
+
+    void handleInitialisation(uint16_t numFrequencies, uint16_t newChunkSize);
+
+    // Returns false if the chunk was rejected
+    bool handleContent(SpikeDecoder::ByteView frequencies);
+
+    // Set before the receivers start, negative to keep one oscillator per neuron
+    std::atomic<float> mergeToleranceCents {0.f};
+
+    std::mutex mutex;
+    std::atomic<bool> systemIsInInitMode {};
+    std::vector<float> listOfFrequencies;
+    uint16_t numFrequenciesReceived {};
+    uint16_t chunkSize {};
+    FrequencyIndex mergedVoices;
+    uint32_t mergedVoicesVersion {};
+
+private:
+    void finish();
+};
+
+//==============================================================================
+/*
+    One UDP socket with its own receive thread. Performance messages are put
+    into the queue it was given, everything else is forwarded to the shared
+    NeuronInitialisation. A queued spike is its neuron index in the low 24 bits
+    and its weight byte in the top 8, so a weighted spike takes no more room
+    than a plain one. The spikes of a datagram are gathered on the receive
+    thread and pushed into the queue in one go when it has been decoded.
+
+    The receiver can be started, stopped and rebound to another port any number
+    of times. The thread sleeps in poll() on the socket and on a wakeup event,
+    so stop() returns as soon as the thread has seen the wakeup; once it has
+    returned, the thread no longer touches the queue or the initialisation.
+*/
+class UdpSpikeReceiver
+{
+public:
+    using Queue = SpikeRing<uint32_t>;
+
+    static constexpr uint32_t maxQueuedIndex = (1u << 24) - 1;
+
+    UdpSpikeReceiver(int receiverId, Queue& queue, NeuronInitialisation& initialisation, SpikeRecorder& recorder,
+                     ThreadTuning& threadTuning);
+    ~UdpSpikeReceiver();
+
+    // With sharePort set, several receivers can bind the same port and the
+    // kernel spreads the incoming senders across them (SO_REUSEPORT)
+    juce::Result start(int port, bool sharePort);
+    void stop();
+    juce::Result rebind(int newPort, bool sharePort);
+
+    bool isRunning() const { return udpThread.joinable(); }
+    int getPort() const { return port; }
+
+    uint64_t getNumSpikes() const { return numSpikes.load(std::memory_order_relaxed); }
+    uint64_t getNumInitialisationMessages() const { return numInitialisationMessages.load(std::memory_order_relaxed); }
+    uint64_t getNumUnknownMessages() const { return numUnknownMessages.load(std::memory_order_relaxed); }
+    uint64_t getNumMalformedMessages() const { return numMalformedMessages.load(std::memory_order_relaxed); }
+    uint64_t getNumSpikesDropped() const { return queue.getNumOverflows(); }
+    void addStreamStats(StreamStats& stats) const { streamCounters.addTo(stats); }
+
+    // What this receiver tells senders in answer to a hello
+    static Capabilities getCapabilities()
+    {
+        return {protocolVersion, Capabilities::index16 | Capabilities::index32,
+                Capabilities::untimed | Capabilities::senderClockNanos, maxPacketBatch, Capabilities::weightedSpikes};
+    }
+
+    // Called back by SpikeDecoder::decode() on the receive thread
+    void onPacket(PacketHeader const& header);
+    void onPerformance(uint32_t index, uint8_t weight);
+    void onInitialisation(uint16_t numFrequencies, uint16_t chunkSize);
+    void onInitialisationContent(SpikeDecoder::ByteView frequencies);
+    void onHello(PacketHeader const& header, Capabilities const& sender);
+
+    // Audio belongs on the mixer's port, see ShardMixer
+    void onAudio(PacketHeader const&, AudioBlockHeader const&, SpikeDecoder::ByteView)
+    {
+        numUnknownMessages.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    void run();
+    void drainSocket();
+    void handleDatagram(uint8_t const* buffer, int numBytes);
+    void flushStaged();
+
+    bool openWakeup();
+    void closeWakeup();
+    void wakeUp();
+
+    int const receiverId;
+    Queue& queue;
+    NeuronInitialisation& initialisation;
+    SpikeRecorder& recorder;
+    ThreadTuning& threadTuning;
+
+    int port {};
+    std::unique_ptr<juce::DatagramSocket> udp;
+    std::thread udpThread;
+    std::atomic<bool> stopRequested {false};
+
+    // eventfd on Linux, a pipe elsewhere: [0] is polled, [1] written to wake up
+    int wakeupFds[2] {-1, -1};
+
+    // Where the datagram being handled came from, for replies
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+    sockaddr_storage senderAddress {};
+    socklen_t senderAddressLength {};
+#else
+    juce::String senderAddress;
+    int senderPort {};
+#endif
+    uint64_t senderKey {};
+
+    // Spikes of the datagram being decoded, not yet in the queue
+    std::array<uint32_t, maxPacketBatch> staged {};
+    int numStaged {};
+
+    SequenceTracker sequenceTracker;
+    StreamCounters streamCounters;
+
+    std::atomic<uint64_t> numSpikes {0};
+    std::atomic<uint64_t> numInitialisationMessages {0};
+    std::atomic<uint64_t> numUnknownMessages {0};
+    std::atomic<uint64_t> numMalformedMessages {0};
+};
+
+//==============================================================================
+/*
+    All UDP listeners, as one spike source. Every receiver feeds its own single
+    producer queue and the audio thread merges them round robin, a burst at a
+    time, so no receiver can starve the others.
+
+    The listeners are described by a port list such as "5001", "5001x4" (four
+    listeners sharing port 5001) or "5001,5002,6000x2". An entry "shm" or
+    "shm:/name" additionally creates a SharedSpikeRing that co-located
+    simulators can push into; the audio thread pops it directly, without a
+    receiver thread in between. Changing the port list keeps the ring, and
+    the simulators attached to it, unless the ring's name changes.
+*/
+class UdpSpikeInput : public SpikeSource
+{
+public:
+    static constexpr int maxNumReceivers               = 16;
+    static constexpr int defaultPort                   = 5001;
+    static constexpr char const* defaultSharedRingName = "/oscweb-spikes";
+    static constexpr uint32_t sharedRingCapacity       = 1 << 16;
+
+    UdpSpikeInput(SpikeRecorder& recorder, ThreadTuning& threadTuning);
+    ~UdpSpikeInput() override;
+
+    // Replaces all current listeners, call from the message thread
+    juce::Result setPorts(juce::String const& portList);
+
+    // Stops every listener and removes the shared ring
+    void stop();
+
+    int pullSpikes(int numSamples, int numNeurons, int* dest, int maxSpikes) override;
+    int pullWeightedSpikes(int numSamples, int numNeurons, int* dest, float* weights, int maxSpikes) override;
+
+    // Totals over all receivers, safe to read from any thread
+    uint64_t getNumSpikesReceived() const { return sum(&UdpSpikeReceiver::getNumSpikes); }
+    uint64_t getNumInitialisationMessages() const { return sum(&UdpSpikeReceiver::getNumInitialisationMessages); }
+    uint64_t getNumUnknownMessages() const { return sum(&UdpSpikeReceiver::getNumUnknownMessages); }
+    uint64_t getNumMalformedMessages() const { return sum(&UdpSpikeReceiver::getNumMalformedMessages); }
+    uint64_t getNumSpikesDropped() const { return sum(&UdpSpikeReceiver::getNumSpikesDropped); }
+    size_t getQueueDepth() const;
+    StreamStats getStreamStats() const;
+
+    NeuronInitialisation initialisation;
+
+private:
+    // Opens, keeps or closes the shared ring, an empty name closes it
+    juce::Result updateSharedRing(juce::String const& ringName);
+
+    uint64_t sum(uint64_t (UdpSpikeReceiver::*counter)() const) const
+    {
+        uint64_t total = 0;
+        for (auto const& receiver : receivers) { total += ((*receiver).*counter)(); }
+        return total;
+    }
+
+    SpikeRecorder& recorder;
+    ThreadTuning& threadTuning;
+
+    // Receivers and their queues live as long as the input, so the audio
+    // thread never sees a queue disappear; reconfiguring only restarts them
+    std::array<std::unique_ptr<UdpSpikeReceiver::Queue>, maxNumReceivers> queues;
+    std::array<std::unique_ptr<UdpSpikeReceiver>, maxNumReceivers> receivers;
+    int nextQueue {};
+
+    juce::SpinLock sharedRingLock;
+    SharedSpikeRing sharedRing;
+};
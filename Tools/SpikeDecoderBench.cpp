@@ -0,0 +1,99 @@
+#include "../Source/SpikeDecoder.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+//==============================================================================
+/*
+    Packets per second through SpikeDecoder::decode(), for the datagram shapes
+    the UDP input sees most. Like the fuzz target it builds without JUCE:
+
+        g++ -std=c++17 -O2 Tools/SpikeDecoderBench.cpp -o SpikeDecoderBench
+        ./SpikeDecoderBench
+
+    Every shape is decoded for about a second with a handler that only sums
+    the spike indices, so the numbers are the decoder alone, without queues.
+*/
+namespace
+{
+struct SumHandler
+{
+    void onPerformance(uint32_t index, uint8_t weight) { sum += index + weight; }
+    void onInitialisation(uint16_t, uint16_t) { }
+    void onInitialisationContent(SpikeDecoder::ByteView) { }
+    void onPacket(PacketHeader const&) { }
+    void onHello(PacketHeader const&, Capabilities const&) { }
+    void onAudio(PacketHeader const&, AudioBlockHeader const&, SpikeDecoder::ByteView) { }
+
+    uint64_t sum {};
+};
+
+// Keeps the handler's work from being optimised away
+volatile uint64_t sink {};
+
+std::vector<uint8_t> makeLegacySpike()
+{
+    return {static_cast<uint8_t>(MessageType::Performance), 0x34, 0x12};
+}
+
+std::vector<uint8_t> makeSpikePacket(uint16_t count, uint8_t flags)
+{
+    auto const indexSize = (flags & PacketFlags::wideIndices) != 0 ? 4 : 2;
+    auto const width     = indexSize + ((flags & PacketFlags::weighted) != 0 ? 1 : 0);
+
+    std::vector<uint8_t> packet(packetHeaderSize + packetTimeSize + static_cast<size_t>(count * width));
+    auto offset = writePacketHeader(packet.data(), {protocolVersion, flags, PacketType::spikes, count, 1, 0});
+
+    for (int i = 0; i < count; i++)
+    {
+        for (int byte = 0; byte < width; byte++) { packet[offset++] = static_cast<uint8_t>((i * 7 + byte) & 0xff); }
+    }
+
+    packet.resize(offset);
+    return packet;
+}
+
+void run(char const* name, std::vector<uint8_t> const& packet, int spikesPerPacket)
+{
+    using Clock = std::chrono::steady_clock;
+
+    SumHandler handler;
+    uint64_t numPackets = 0;
+    auto const start    = Clock::now();
+    auto elapsed        = std::chrono::duration<double>(0.0);
+
+    while (elapsed.count() < 1.0)
+    {
+        for (int i = 0; i < 4096; i++)
+        {
+            if (SpikeDecoder::decode(packet.data(), packet.size(), handler) != SpikeDecoder::Error::none)
+            {
+                std::printf("%s does not decode\n", name);
+                return;
+            }
+        }
+
+        numPackets += 4096;
+        elapsed = Clock::now() - start;
+    }
+
+    auto const packetsPerSecond = static_cast<double>(numPackets) / elapsed.count();
+
+    sink = handler.sum;
+
+    std::printf("%-32s %8.2f M packets/s %9.2f M spikes/s\n", name, packetsPerSecond * 1.0e-6,
+                packetsPerSecond * spikesPerPacket * 1.0e-6);
+}
+}  // namespace
+
+int main()
+{
+    run("legacy, 1 spike", makeLegacySpike(), 1);
+    run("packet, 1 x 16 bit", makeSpikePacket(1, 0), 1);
+    run("packet, 256 x 16 bit", makeSpikePacket(256, 0), 256);
+    run("packet, 1024 x 16 bit timed", makeSpikePacket(1024, PacketFlags::timestamped), 1024);
+    run("packet, 1024 x 32 bit", makeSpikePacket(1024, PacketFlags::wideIndices), 1024);
+    run("packet, 1024 x 16 bit + weight", makeSpikePacket(1024, PacketFlags::weighted), 1024);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include "../Source/SpikeDecoder.h"
+
+//==============================================================================
+/*
+    libFuzzer target for SpikeDecoder::decode(). The decoder and SpikeProtocol.h
+    do not depend on JUCE, so this builds on its own, e.g.
+
+        clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address,undefined \
+            Tools/SpikeDecoderFuzz.cpp -o SpikeDecoderFuzz
+        ./SpikeDecoderFuzz -max_len=65536
+
+    The handler does nothing with what it is given, apart from reading every
+    byte of the views it is handed, so that a view reaching past the end of
+    the datagram shows up under the address sanitizer.
+*/
+namespace
+{
+struct NullHandler
+{
+    void onPerformance(uint32_t, uint8_t) { }
+    void onInitialisation(uint16_t, uint16_t) { }
+    void onInitialisationContent(SpikeDecoder::ByteView frequencies) { touch(frequencies); }
+    void onPacket(PacketHeader const&) { }
+    void onHello(PacketHeader const&, Capabilities const&) { }
+
+    void onAudio(PacketHeader const&, AudioBlockHeader const&, SpikeDecoder::ByteView samples) { touch(samples); }
+
+    void touch(SpikeDecoder::ByteView view)
+    {
+        for (size_t i = 0; i < view.size(); i++) { sum += view.readUint8(i); }
+    }
+
+    uint32_t sum {};
+};
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size)
+{
+    NullHandler handler;
+    SpikeDecoder::decode(data, size, handler);
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include "../Source/SpikeRing.h"
+#include "../Source/readerwriterqueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+//==============================================================================
+/*
+    Spikes per second from one producer thread to one consumer thread, through
+    the ReaderWriterQueue the UDP receivers used to have and through SpikeRing.
+    Neither depends on JUCE, so this builds on its own:
+
+        g++ -std=c++17 -O2 -pthread Tools/SpikeRingBench.cpp -o SpikeRingBench
+        ./SpikeRingBench
+
+    The producer sends bursts of up to producerBurst spikes, as a receiver
+    does for one datagram; the consumer takes up to consumerBurst at a time,
+    as the audio thread does for one sub-block. Both yield when they cannot
+    make progress, so the numbers are meaningful on a single core as well.
+*/
+namespace
+{
+constexpr int numSpikes     = 5000000;
+constexpr int capacity      = 4096;
+constexpr int producerBurst = 64;
+constexpr int consumerBurst = 256;
+
+template <typename Push, typename Pop>
+double measure(Push&& push, Pop&& pop)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto const start = Clock::now();
+
+    std::thread producer([&push] {
+        uint32_t burst[producerBurst];
+        int numSent = 0;
+
+        while (numSent < numSpikes)
+        {
+            auto const numToSend = std::min(producerBurst, numSpikes - numSent);
+            for (int i = 0; i < numToSend; i++) { burst[i] = static_cast<uint32_t>(numSent + i); }
+
+            auto const numPushed = push(burst, numToSend);
+            numSent += numPushed;
+
+            if (numPushed < numToSend) { std::this_thread::yield(); }
+        }
+    });
+
+    uint32_t received[consumerBurst];
+    uint64_t sum    = 0;
+    int numReceived = 0;
+
+    while (numReceived < numSpikes)
+    {
+        auto const numPopped = pop(received, consumerBurst);
+        for (int i = 0; i < numPopped; i++) { sum += received[i]; }
+
+        numReceived += numPopped;
+        if (numPopped == 0) { std::this_thread::yield(); }
+    }
+
+    producer.join();
+
+    auto const seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (sum != static_cast<uint64_t>(numSpikes) * (numSpikes - 1) / 2)
+    {
+        std::printf("spikes were lost or reordered\n");
+        return 0.0;
+    }
+
+    return numSpikes / seconds;
+}
+
+void report(char const* name, double spikesPerSecond)
+{
+    std::printf("%-36s %8.1f M spikes/s\n", name, spikesPerSecond * 1.0e-6);
+}
+}  // namespace
+
+int main()
+{
+    for (int round = 0; round < 3; round++)
+    {
+        moodycamel::ReaderWriterQueue<uint32_t> queue(capacity);
+        SpikeRing<uint32_t> single(capacity);
+        SpikeRing<uint32_t> batched(capacity);
+
+        auto const queuePush = [&queue](uint32_t const* values, int count) {
+            int numPushed = 0;
+            while (numPushed < count && queue.try_enqueue(values[numPushed])) { numPushed++; }
+            return numPushed;
+        };
+
+        auto const queuePop = [&queue](uint32_t* dest, int maxCount) {
+            int numPopped = 0;
+            while (numPopped < maxCount && queue.try_dequeue(dest[numPopped])) { numPopped++; }
+            return numPopped;
+        };
+
+        auto const singlePush = [&single](uint32_t const* values, int count) {
+            int numPushed = 0;
+            while (numPushed < count && single.push(values[numPushed])) { numPushed++; }
+            return numPushed;
+        };
+
+        auto const singlePop = [&single](uint32_t* dest, int maxCount) {
+            int numPopped = 0;
+            while (numPopped < maxCount && single.pop(dest + numPopped, 1) == 1) { numPopped++; }
+            return numPopped;
+        };
+
+        auto const batchedPush = [&batched](uint32_t const* values, int count) { return batched.push(values, count); };
+        auto const batchedPop  = [&batched](uint32_t* dest, int maxCount) { return batched.pop(dest, maxCount); };
+
+        report("ReaderWriterQueue, per spike", measure(queuePush, queuePop));
+        report("SpikeRing, per spike", measure(singlePush, singlePop));
+        report("SpikeRing, in bursts", measure(batchedPush, batchedPop));
+        std::printf("\n");
+    }
+
+    return 0;
+}